@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "affinematrix.hpp"
+
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AFFINEMATRICES_SSE 1
+#include <emmintrin.h>
+#endif
+
+// Every path must round each multiply and add separately, otherwise fused
+// multiply-adds make the SIMD results drift from the scalar reference.
+// CMakeLists.txt builds this file with -ffp-contract=off (/fp:precise on MSVC).
+
+// For M = [A t; 0 1] with columns c0, c1, c2 of A, the rows of inverse(A) are
+// cross(c1, c2), cross(c2, c0) and cross(c0, c1) divided by det(A). Those rows r_i are the
+// columns of the inverse-transpose, and the translation -inverse(A) * t ends up in its
+// bottom row as -dot(r_i, t).
+
+static inline bool isAffine(const float* m)
+{
+  return m[3] == 0.0f && m[7] == 0.0f && m[11] == 0.0f && m[15] == 1.0f;
+}
+
+static inline bool isInvertible(float det)
+{
+  return det != 0.0f && std::isfinite(det);
+}
+
+static void generalInverseTranspose(const float* m, float* out)
+{
+  glm::mat4 it = glm::transpose(glm::inverse(glm::make_mat4(m)));
+  memcpy(out, glm::value_ptr(it), sizeof(float) * 16);
+}
+
+static inline float dot3(const float* a, const float* b)
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void cross3(const float* a, const float* b, float* out)
+{
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static size_t inverseTransposeScalar(const float* matrices, size_t matrixStride, size_t numMatrices, float* outIT, size_t outStride)
+{
+  size_t numGeneral = 0;
+  for(size_t i = 0; i < numMatrices; i++)
+  {
+    const float* m   = (const float*)((const uint8_t*)matrices + matrixStride * i);
+    float*       out = (float*)((uint8_t*)outIT + outStride * i);
+
+    float r[3][3];
+    cross3(m + 4, m + 8, r[0]);
+    cross3(m + 8, m + 0, r[1]);
+    cross3(m + 0, m + 4, r[2]);
+
+    float det = dot3(m + 0, r[0]);
+    if(!isAffine(m) || !isInvertible(det))
+    {
+      generalInverseTranspose(m, out);
+      numGeneral++;
+      continue;
+    }
+
+    float invDet = 1.0f / det;
+    for(int c = 0; c < 3; c++)
+    {
+      out[c * 4 + 0] = r[c][0] * invDet;
+      out[c * 4 + 1] = r[c][1] * invDet;
+      out[c * 4 + 2] = r[c][2] * invDet;
+      out[c * 4 + 3] = -dot3(out + c * 4, m + 12);
+    }
+    out[12] = 0.0f;
+    out[13] = 0.0f;
+    out[14] = 0.0f;
+    out[15] = 1.0f;
+  }
+  return numGeneral;
+}
+
+#if AFFINEMATRICES_SSE
+// lanes x, y, z are used, w is ignored
+static inline __m128 crossSSE(__m128 a, __m128 b)
+{
+  __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+  __m128 b_zxy = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2));
+  __m128 a_zxy = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2));
+  __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+  return _mm_sub_ps(_mm_mul_ps(a_yzx, b_zxy), _mm_mul_ps(a_zxy, b_yzx));
+}
+
+// (x + y) + z in lane 0, same order as dot3
+static inline __m128 dotSSE(__m128 a, __m128 b)
+{
+  __m128 m = _mm_mul_ps(a, b);
+  __m128 s = _mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1)));
+  return _mm_add_ss(s, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+
+static size_t inverseTransposeSSE(const float* matrices, size_t matrixStride, size_t numMatrices, float* outIT, size_t outStride)
+{
+  const __m128 one      = _mm_set1_ps(1.0f);
+  const __m128 signMask = _mm_set1_ps(-0.0f);
+
+  size_t numGeneral = 0;
+  for(size_t i = 0; i < numMatrices; i++)
+  {
+    const float* m   = (const float*)((const uint8_t*)matrices + matrixStride * i);
+    float*       out = (float*)((uint8_t*)outIT + outStride * i);
+
+    __m128 c0 = _mm_loadu_ps(m + 0);
+    __m128 c1 = _mm_loadu_ps(m + 4);
+    __m128 c2 = _mm_loadu_ps(m + 8);
+    __m128 t  = _mm_loadu_ps(m + 12);
+
+    __m128 r0 = crossSSE(c1, c2);
+    __m128 r1 = crossSSE(c2, c0);
+    __m128 r2 = crossSSE(c0, c1);
+
+    float det = _mm_cvtss_f32(dotSSE(c0, r0));
+    if(!isAffine(m) || !isInvertible(det))
+    {
+      generalInverseTranspose(m, out);
+      numGeneral++;
+      continue;
+    }
+
+    __m128 invDet = _mm_div_ps(one, _mm_set1_ps(det));
+    r0            = _mm_mul_ps(r0, invDet);
+    r1            = _mm_mul_ps(r1, invDet);
+    r2            = _mm_mul_ps(r2, invDet);
+
+    // w = -dot(r, t), negation only flips the sign bit like the scalar path
+    __m128 w0 = _mm_xor_ps(dotSSE(r0, t), signMask);
+    __m128 w1 = _mm_xor_ps(dotSSE(r1, t), signMask);
+    __m128 w2 = _mm_xor_ps(dotSSE(r2, t), signMask);
+
+    // move w into lane 3: (x, y, z, w)
+    r0 = _mm_shuffle_ps(r0, _mm_shuffle_ps(r0, w0, _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+    r1 = _mm_shuffle_ps(r1, _mm_shuffle_ps(r1, w1, _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+    r2 = _mm_shuffle_ps(r2, _mm_shuffle_ps(r2, w2, _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0));
+
+    _mm_storeu_ps(out + 0, r0);
+    _mm_storeu_ps(out + 4, r1);
+    _mm_storeu_ps(out + 8, r2);
+    _mm_storeu_ps(out + 12, _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f));
+  }
+  return numGeneral;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+
+AffineMatrixPath affineMatrixGetBestPath()
+{
+#if AFFINEMATRICES_SSE
+  return AFFINEMATRIX_SSE;
+#else
+  return AFFINEMATRIX_SCALAR;
+#endif
+}
+
+const char* affineMatrixGetPathName(AffineMatrixPath path)
+{
+  switch(path)
+  {
+    case AFFINEMATRIX_SCALAR:
+      return "scalar";
+    case AFFINEMATRIX_SSE:
+      return "sse";
+    default:
+      return "unknown";
+  }
+}
+
+size_t affineMatrixInverseTranspose(const float* matrices, size_t matrixStride, size_t numMatrices, float* outIT, size_t outStride, AffineMatrixPath path)
+{
+  switch(path)
+  {
+#if AFFINEMATRICES_SSE
+    case AFFINEMATRIX_SSE:
+      return inverseTransposeSSE(matrices, matrixStride, numMatrices, outIT, outStride);
+#endif
+    default:
+      return inverseTransposeScalar(matrices, matrixStride, numMatrices, outIT, outStride);
+  }
+}
+
+void affineMatrixBenchmark(size_t numMatrices)
+{
+  std::vector<glm::mat4> matrices(numMatrices);
+
+  // rotation, non-uniform scale and translation like typical CAD node matrices
+  std::mt19937                          rng(1234);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for(size_t i = 0; i < numMatrices; i++)
+  {
+    glm::vec4 q = glm::vec4(dist(rng), dist(rng), dist(rng), dist(rng)) + glm::vec4(0.0f, 0.0f, 0.0f, 2.0f);
+    q           = q * (1.0f / glm::length(q));
+
+    float x = q.x;
+    float y = q.y;
+    float z = q.z;
+    float w = q.w;
+
+    glm::mat4& mat = matrices[i];
+    mat[0]         = glm::vec4(1 - 2 * (y * y + z * z), 2 * (x * y + z * w), 2 * (x * z - y * w), 0);
+    mat[1]         = glm::vec4(2 * (x * y - z * w), 1 - 2 * (x * x + z * z), 2 * (y * z + x * w), 0);
+    mat[2]         = glm::vec4(2 * (x * z + y * w), 2 * (y * z - x * w), 1 - 2 * (x * x + y * y), 0);
+    mat[0]         = mat[0] * (1.0f + dist(rng) * 0.9f);
+    mat[1]         = mat[1] * (1.0f + dist(rng) * 0.9f);
+    mat[2]         = mat[2] * (1.0f + dist(rng) * 0.9f);
+    mat[3]         = glm::vec4(dist(rng) * 100.0f, dist(rng) * 100.0f, dist(rng) * 100.0f, 1.0f);
+  }
+
+  std::vector<glm::mat4> glmResult(numMatrices);
+  std::vector<glm::mat4> reference(numMatrices);
+  std::vector<glm::mat4> result(numMatrices);
+
+  LOGI("affinematrix benchmark: %zu matrices\n", numMatrices);
+
+  {
+    auto begin = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < numMatrices; i++)
+    {
+      glmResult[i] = glm::transpose(glm::inverse(matrices[i]));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    LOGI("  %-6s: %9.2f Mmatrices/s\n", "glm", seconds > 0 ? double(numMatrices) / seconds / 1000000.0 : 0.0);
+  }
+
+  for(int p = 0; p <= int(affineMatrixGetBestPath()); p++)
+  {
+    AffineMatrixPath        path   = AffineMatrixPath(p);
+    std::vector<glm::mat4>& output = path == AFFINEMATRIX_SCALAR ? reference : result;
+
+    auto begin = std::chrono::steady_clock::now();
+    affineMatrixInverseTranspose(glm::value_ptr(matrices[0]), sizeof(glm::mat4), numMatrices,
+                                 glm::value_ptr(output[0]), sizeof(glm::mat4), path);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    // bit-exact against scalar, relative to the largest element against glm
+    size_t mismatches = 0;
+    float  maxError   = 0;
+    for(size_t i = 0; i < numMatrices; i++)
+    {
+      mismatches += memcmp(&reference[i], &output[i], sizeof(glm::mat4)) != 0 ? 1 : 0;
+
+      float largest = 0;
+      float error   = 0;
+      for(int c = 0; c < 4; c++)
+      {
+        for(int r = 0; r < 4; r++)
+        {
+          largest = std::max(largest, std::abs(glmResult[i][c][r]));
+          error   = std::max(error, std::abs(glmResult[i][c][r] - output[i][c][r]));
+        }
+      }
+      maxError = std::max(maxError, largest > 0 ? error / largest : error);
+    }
+
+    LOGI("  %-6s: %9.2f Mmatrices/s, mismatches %zu, max rel. deviation from glm %.2e\n", affineMatrixGetPathName(path),
+         seconds > 0 ? double(numMatrices) / seconds / 1000000.0 : 0.0, mismatches, maxError);
+  }
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef AFFINEMATRIX_H__
+#define AFFINEMATRIX_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Batched inverse-transpose for the node matrices of CadScene::MatrixNode.
+// Affine matrices use the 3x3 adjugate, everything else falls back to glm::inverse.
+// All paths produce bit-identical results to the scalar reference.
+
+enum AffineMatrixPath
+{
+  AFFINEMATRIX_SCALAR,
+  AFFINEMATRIX_SSE,  // one matrix per iteration
+  NUM_AFFINEMATRIX_PATHS,
+};
+
+// widest path that was compiled in
+AffineMatrixPath affineMatrixGetBestPath();
+const char*      affineMatrixGetPathName(AffineMatrixPath path);
+
+// matrices: column-major float 4x4, consecutive matrices are matrixStride bytes apart
+// outIT:    receives transpose(inverse(matrix)), consecutive results are outStride bytes apart
+// returns the number of matrices that were not affine (or singular) and took the general inverse
+size_t affineMatrixInverseTranspose(const float* matrices, size_t matrixStride, size_t numMatrices, float* outIT, size_t outStride, AffineMatrixPath path);
+
+// times glm and all supported paths on numMatrices random rotation/scale/translation matrices,
+// verifies they match the scalar reference and prints matrices/sec and the deviation from glm
+void affineMatrixBenchmark(size_t numMatrices);
+
+#endif
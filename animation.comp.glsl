@@ -37,6 +37,11 @@ layout(binding=ANIM_SSBO_MATRIXORIG, std430) restrict buffer matricesOrigBuffer
   MatrixData original[];
 };
 
+// matrices of the same node, e.g. the dequantization copies, move together
+layout(binding=ANIM_SSBO_MATRIXNODE, std430) restrict readonly buffer matrixNodesBuffer {
+  AnimationNode nodes[];
+};
+
 void main()
 {
   int self = int(gl_GlobalInvocationID.x);
@@ -44,7 +49,9 @@ void main()
     return;
   }
   
-  float s = 1-(float(self)/float(anim.numMatrices));
+  AnimationNode node = nodes[self];
+
+  float s = 1-(float(node.index)/float(anim.numNodes));
   float movement = 4;             // time until all objects done with moving (<= sequence*0.5)
   float sequence = movement*2+3;  // time for sequence
   
@@ -55,10 +62,10 @@ void main()
   
   mat4 matrixOrig     = original[self].worldMatrix;
   vec3 pos  = matrixOrig[3].xyz;
-  vec3 away = (pos - anim.sceneCenter );
+  vec3 away = (node.position - anim.sceneCenter );
   
-  float diridx  = float(self % 3);
-  float sidx    = float(self % 6);
+  float diridx  = float(node.index % 3u);
+  float sidx    = float(node.index % 6u);
 
   vec3 delta;
   #if 1
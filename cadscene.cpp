@@ -19,10 +19,18 @@
 
 
 #include "cadscene.hpp"
+#include "affinematrix.hpp"
+#include "octnormals.hpp"
+#include "threadpool.hpp"
+#include "vertexcache.hpp"
 #include <fileformats/cadscenefile.h>
 
 #include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <unordered_map>
 #include <glm/gtc/type_ptr.hpp>
 
 #define USE_CACHECOMBINE 1
@@ -39,73 +47,86 @@ glm::vec4 randomVector(float from, float to)
   return vec;
 }
 
-// all oct functions derived from "A Survey of Efficient Representations for Independent Unit Vectors"
-// http://jcgt.org/published/0003/02/01/paper.pdf
-// Returns +/- 1
-inline glm::vec3 oct_signNotZero(glm::vec3 v)
-{
-  // leaves z as is
-  return glm::vec3((v.x >= 0.0f) ? +1.0f : -1.0f, (v.y >= 0.0f) ? +1.0f : -1.0f, 1.0f);
-}
+// blocks of the scene memory arena, larger geometries get their own
+static const size_t s_arenaBlockSize = size_t(64) * 1024 * 1024;
 
-// Assume normalized input. Output is on [-1, 1] for each component.
-inline glm::vec3 float32x3_to_oct(glm::vec3 v)
+static double getTimeMs()
 {
-  // Project the sphere onto the octahedron, and then onto the xy plane
-  glm::vec3 p = glm::vec3(v.x, v.y, 0) * (1.0f / (fabsf(v.x) + fabsf(v.y) + fabsf(v.z)));
-  // Reflect the folds of the lower hemisphere over the diagonals
-  return (v.z <= 0.0f) ? glm::vec3(1.0f - fabsf(p.y), 1.0f - fabsf(p.x), 0.0f) * oct_signNotZero(p) : p;
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
-inline glm::vec3 oct_to_float32x3(glm::vec3 e)
+bool CadScene::loadCSF(const char* filename, const LoadConfig& config, int clones, int cloneaxis)
 {
-  glm::vec3 v = glm::vec3(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
-  if(v.z < 0.0f)
+  m_loadStats            = LoadStats();
+  m_loadStats.numThreads = config.numThreads ? config.numThreads : ThreadPool::sysGetNumCores();
+  m_quantizedVertices    = config.quantizedVertices;
+  m_arena.init(s_arenaBlockSize, config.hugePages);
+
+  double timeBegin = getTimeMs();
+
+  std::string cacheFilename = std::string(filename) + ".csfcache";
+  uint64_t    sourceHash    = 0;
+  uint64_t    sourceSize    = 0;
+
+  bool loaded = false;
+  if(config.useCache && hashFile(filename, sourceHash, sourceSize))
   {
-    v = glm::vec3(1.0f - fabs(v.y), 1.0f - fabs(v.x), v.z) * oct_signNotZero(v);
+    loaded                 = loadCache(cacheFilename.c_str(), sourceHash, sourceSize, config);
+    m_loadStats.cacheState = loaded ? LoadStats::CACHE_LOADED : LoadStats::CACHE_MISS;
+    m_loadStats.timeCache  = getTimeMs() - timeBegin;
   }
-  return glm::normalize(v);
-}
 
-inline glm::vec3 float32x3_to_octn_precise(glm::vec3 v, const int n)
-{
-  glm::vec3 s = float32x3_to_oct(v);  // Remap to the square
-                                      // Each snorm's max value interpreted as an integer,
-                                      // e.g., 127.0 for snorm8
-  float M = float(1 << ((n / 2) - 1)) - 1.0;
-  // Remap components to snorm(n/2) precision...with floor instead
-  // of round (see equation 1)
-  s                            = glm::floor(glm::clamp(s, -1.0f, +1.0f) * M) * (1.0f / M);
-  glm::vec3 bestRepresentation = s;
-  float     highestCosine      = glm::dot(oct_to_float32x3(s), v);
-  // Test all combinations of floor and ceil and keep the best.
-  // Note that at +/- 1, this will exit the square... but that
-  // will be a worse encoding and never win.
-  for(int i = 0; i <= 1; ++i)
-  {
-    for(int j = 0; j <= 1; ++j)
-    {
-      // This branch will be evaluated at compile time
-      if((i != 0) || (j != 0))
+  if(!loaded)
+  {
+    if(!loadCSFScene(filename, config))
+    {
+      return false;
+    }
+
+    if(m_loadStats.cacheState == LoadStats::CACHE_MISS)
+    {
+      double timeSave = getTimeMs();
+      if(saveCache(cacheFilename.c_str(), sourceHash, sourceSize, config))
       {
-        // Offset the bit pattern (which is stored in floating
-        // point!) to effectively change the rounding mode
-        // (when i or j is 0: floor, when it is one: ceiling)
-        glm::vec3 candidate = glm::vec3(i, j, 0) * (1 / M) + s;
-        float     cosine    = glm::dot(oct_to_float32x3(candidate), v);
-        if(cosine > highestCosine)
-        {
-          bestRepresentation = candidate;
-          highestCosine      = cosine;
-        }
+        m_loadStats.cacheState = LoadStats::CACHE_WRITTEN;
       }
+      m_loadStats.timeCache += getTimeMs() - timeSave;
+    }
+  }
+
+  for(const Geometry& geom : m_geometry)
+  {
+    if(geom.indexSize == sizeof(uint16_t))
+    {
+      // 32-bit indices would have taken twice the size
+      m_loadStats.numShortIndexGeometries++;
+      m_loadStats.shortIndexSavedBytes += geom.iboSize;
     }
   }
-  return bestRepresentation;
+
+  double timeClones = getTimeMs();
+  createClones(clones, cloneaxis, config.cloneInstancing);
+  m_loadStats.timeClones = getTimeMs() - timeClones;
+  m_loadStats.arena      = m_arena.getStats();
+  m_loadStats.timeTotal  = getTimeMs() - timeBegin;
+
+  return true;
 }
 
-bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
+bool CadScene::loadCSFScene(const char* filename, const LoadConfig& config)
 {
+  uint32_t         numThreads = m_loadStats.numThreads;
+  OctNormalPath    normalPath = config.simdNormals ? octNormalsGetBestPath() : OCTNORMAL_SCALAR;
+  AffineMatrixPath matrixPath = config.simdMatrices ? affineMatrixGetBestPath() : AFFINEMATRIX_SCALAR;
+  double           timeLast   = getTimeMs();
+
+  auto phaseTime = [&timeLast]() {
+    double time     = getTimeMs();
+    double duration = time - timeLast;
+    timeLast        = time;
+    return duration;
+  };
+
   CSFile*         csf;
   CSFileMemoryPTR mem = CSFileMemory_new();
   if(CSFile_loadExt(&csf, filename, mem) != CADSCENEFILE_NOERROR || !(csf->fileFlags & CADSCENEFILE_FLAG_UNIQUENODES))
@@ -114,12 +135,11 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     return false;
   }
 
-  int copies = clones + 1;
-
   CSFile_transform(csf);
 
   srand(234525);
 
+  m_loadStats.timeFile = phaseTime();
 
   // materials
   m_materials.resize(csf->numMaterials);
@@ -137,151 +157,617 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
     }
   }
 
+  m_loadStats.timeMaterials = phaseTime();
 
   // geometry
   int numGeoms = csf->numGeometries;
-  m_geometry.resize(csf->numGeometries * copies);
-  m_geometryBboxes.resize(csf->numGeometries * copies);
-  for(int n = 0; n < csf->numGeometries; n++)
-  {
-    CSFGeometry* csfgeom = &csf->geometries[n];
-    Geometry&    geom    = m_geometry[n];
-    geom.cloneIdx        = -1;
+  m_geometry.resize(csf->numGeometries);
+  m_geometryBboxes.resize(csf->numGeometries);
 
-    geom.numVertices   = csfgeom->numVertices;
-    geom.numIndexSolid = csfgeom->numIndexSolid;
-    geom.numIndexWire  = csfgeom->numIndexWire;
+  std::vector<size_t> vertexCacheMissesBefore(numGeoms, 0);
+  std::vector<size_t> vertexCacheMissesAfter(numGeoms, 0);
 
-    Vertex* vertices = new Vertex[csfgeom->numVertices];
-    for(int i = 0; i < csfgeom->numVertices; i++)
+  // every geometry only writes its own slots, so the result is independent of the thread count
+  ThreadPool::parallelBatches(numGeoms, 16, numThreads, [&](size_t begin, size_t end) {
+    for(size_t n = begin; n < end; n++)
     {
-      vertices[i].position[0] = csfgeom->vertex[3 * i + 0];
-      vertices[i].position[1] = csfgeom->vertex[3 * i + 1];
-      vertices[i].position[2] = csfgeom->vertex[3 * i + 2];
+      CSFGeometry* csfgeom = &csf->geometries[n];
+      Geometry&    geom    = m_geometry[n];
+      geom.cloneIdx        = -1;
+
+      geom.numVertices   = csfgeom->numVertices;
+      geom.numIndexSolid = csfgeom->numIndexSolid;
+      geom.numIndexWire  = csfgeom->numIndexWire;
+
+      int numIndices = csfgeom->numIndexSolid + csfgeom->numIndexWire;
 
-      glm::vec3 normal;
-      if(csfgeom->normal)
+      // the optimized index order and the vertex order it was renumbered to, empty when not optimized
+      std::vector<uint32_t> optimizedIndices;
+      std::vector<uint32_t> newToOld;
+
+      const unsigned int* indexSolid = csfgeom->indexSolid;
+      const unsigned int* indexWire  = csfgeom->indexWire;
+
+      int numPartIndexSolid = 0;
+      for(int i = 0; i < csfgeom->numParts; i++)
       {
-        normal.x = csfgeom->normal[3 * i + 0];
-        normal.y = csfgeom->normal[3 * i + 1];
-        normal.z = csfgeom->normal[3 * i + 2];
+        numPartIndexSolid += csfgeom->parts[i].numIndexSolid;
+      }
+
+      if(config.optimizeVertexCache && csfgeom->numIndexSolid && numPartIndexSolid <= csfgeom->numIndexSolid)
+      {
+        optimizedIndices.resize(numIndices);
+        memcpy(&optimizedIndices[0], csfgeom->indexSolid, sizeof(uint32_t) * csfgeom->numIndexSolid);
+        if(csfgeom->indexWire)
+        {
+          memcpy(&optimizedIndices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(uint32_t) * csfgeom->numIndexWire);
+        }
+
+        vertexCacheMissesBefore[n] = vertexCacheCountMisses(&optimizedIndices[0], csfgeom->numIndexSolid, csfgeom->numVertices);
+
+        // triangles only move within their part, so the part ranges stay valid
+        VertexCacheOptimizer optimizer;
+        optimizer.init(csfgeom->numVertices);
+
+        size_t offset = 0;
+        for(int i = 0; i < csfgeom->numParts; i++)
+        {
+          optimizer.optimizeTriangles(&optimizedIndices[offset], csfgeom->parts[i].numIndexSolid);
+          offset += csfgeom->parts[i].numIndexSolid;
+        }
+
+        vertexCacheMissesAfter[n] = vertexCacheCountMisses(&optimizedIndices[0], csfgeom->numIndexSolid, csfgeom->numVertices);
+
+        newToOld.resize(csfgeom->numVertices);
+        vertexFetchOptimize(&optimizedIndices[0], numIndices, csfgeom->numVertices, newToOld.data());
+
+        indexSolid = &optimizedIndices[0];
+        indexWire  = csfgeom->indexWire ? &optimizedIndices[csfgeom->numIndexSolid] : nullptr;
+      }
+
+      std::vector<glm::vec3> normals;
+      if(!csfgeom->normal || !newToOld.empty())
+      {
+        normals.resize(csfgeom->numVertices);
+      }
+
+      // quantized vertices are packed from a temporary, the arena only holds the final data
+      std::vector<Vertex> quantizeSource;
+      Vertex*             vertices = nullptr;
+      if(config.quantizedVertices)
+      {
+        quantizeSource.resize(csfgeom->numVertices);
+        vertices = quantizeSource.data();
       }
       else
       {
-        normal = normalize(glm::vec3(vertices[i].position));
+        vertices = m_arena.allocArray<Vertex>(csfgeom->numVertices);
       }
 
-      glm::vec3 packed       = float32x3_to_octn_precise(normal, 16);
-      vertices[i].normalOctX = std::min(32767, std::max(-32767, int32_t(packed.x * 32767.0f)));
-      vertices[i].normalOctY = std::min(32767, std::max(-32767, int32_t(packed.y * 32767.0f)));
+      for(int i = 0; i < csfgeom->numVertices; i++)
+      {
+        uint32_t src = newToOld.empty() ? uint32_t(i) : newToOld[i];
 
-      m_geometryBboxes[n].merge(glm::vec4(vertices[i].position, 1));
-    }
+        vertices[i].position[0] = csfgeom->vertex[3 * src + 0];
+        vertices[i].position[1] = csfgeom->vertex[3 * src + 1];
+        vertices[i].position[2] = csfgeom->vertex[3 * src + 2];
+
+        if(!csfgeom->normal)
+        {
+          normals[i] = normalize(glm::vec3(vertices[i].position));
+        }
+        else if(!newToOld.empty())
+        {
+          normals[i] = glm::make_vec3(&csfgeom->normal[3 * src]);
+        }
+
+        m_geometryBboxes[n].merge(glm::vec4(vertices[i].position, 1));
+      }
+
+      if(csfgeom->numVertices)
+      {
+        octNormalsEncode(normals.empty() ? csfgeom->normal : &normals[0].x, 3, csfgeom->numVertices,
+                         &vertices[0].normalOctX, sizeof(Vertex), normalPath);
+      }
+
+      if(config.quantizedVertices)
+      {
+        const BBox&      bbox   = m_geometryBboxes[n];
+        glm::vec3        extent = glm::vec3(bbox.max - bbox.min);
+        VertexQuantized* packed = m_arena.allocArray<VertexQuantized>(csfgeom->numVertices);
+
+        for(int i = 0; i < csfgeom->numVertices; i++)
+        {
+          for(int c = 0; c < 3; c++)
+          {
+            float relative        = extent[c] > 0 ? (vertices[i].position[c] - bbox.min[c]) / extent[c] : 0.0f;
+            packed[i].position[c] = uint16_t(std::min(65535.0f, std::max(0.0f, std::round(relative * 65535.0f))));
+          }
+          // the 16-bit oct normals are encoded with snorm8 precision, this is lossless
+          packed[i].normalOctX = int8_t(std::round(float(int16_t(vertices[i].normalOctX)) * (127.0f / 32767.0f)));
+          packed[i].normalOctY = int8_t(std::round(float(int16_t(vertices[i].normalOctY)) * (127.0f / 32767.0f)));
+        }
 
-    geom.vboData = vertices;
-    geom.vboSize = sizeof(Vertex) * csfgeom->numVertices;
+        geom.vboData = packed;
+        geom.vboSize = sizeof(VertexQuantized) * csfgeom->numVertices;
+      }
+      else
+      {
+        geom.vboData = vertices;
+        geom.vboSize = sizeof(Vertex) * csfgeom->numVertices;
+      }
 
 
-    unsigned int* indices = new unsigned int[csfgeom->numIndexSolid + csfgeom->numIndexWire];
-    memcpy(&indices[0], csfgeom->indexSolid, sizeof(unsigned int) * csfgeom->numIndexSolid);
-    if(csfgeom->indexWire)
+      if(config.shortIndices && csfgeom->numVertices <= 0x10000)
+      {
+        uint16_t* indices = m_arena.allocArray<uint16_t>(numIndices);
+        for(int i = 0; i < csfgeom->numIndexSolid; i++)
+        {
+          indices[i] = uint16_t(indexSolid[i]);
+        }
+        for(int i = 0; i < csfgeom->numIndexWire; i++)
+        {
+          indices[csfgeom->numIndexSolid + i] = uint16_t(indexWire[i]);
+        }
+
+        geom.iboData   = indices;
+        geom.indexSize = sizeof(uint16_t);
+      }
+      // the wire indices must directly follow the solid ones to reference the CSF data in place,
+      // the file memory belongs to the loader, so an optimized order is copied like below
+      else if(config.zeroCopyIndices && csfgeom->indexSolid && optimizedIndices.empty()
+              && (!csfgeom->numIndexWire || csfgeom->indexWire == csfgeom->indexSolid + csfgeom->numIndexSolid))
+      {
+        geom.iboData  = csfgeom->indexSolid;
+        geom.iboOwned = false;
+      }
+      else
+      {
+        unsigned int* indices = m_arena.allocArray<unsigned int>(numIndices);
+        memcpy(&indices[0], indexSolid, sizeof(unsigned int) * csfgeom->numIndexSolid);
+        if(indexWire)
+        {
+          memcpy(&indices[csfgeom->numIndexSolid], indexWire, sizeof(unsigned int) * csfgeom->numIndexWire);
+        }
+
+        geom.iboData = indices;
+      }
+      geom.iboSize = size_t(geom.indexSize) * numIndices;
+
+
+      geom.numParts = csfgeom->numParts;
+      geom.parts    = m_arena.allocArray<GeometryPart>(csfgeom->numParts);
+
+      size_t offsetSolid = 0;
+      size_t offsetWire  = csfgeom->numIndexSolid * size_t(geom.indexSize);
+      for(int i = 0; i < csfgeom->numParts; i++)
+      {
+        geom.parts[i].indexWire.count  = csfgeom->parts[i].numIndexWire;
+        geom.parts[i].indexSolid.count = csfgeom->parts[i].numIndexSolid;
+
+        geom.parts[i].indexWire.offset  = offsetWire;
+        geom.parts[i].indexSolid.offset = offsetSolid;
+
+        offsetWire += csfgeom->parts[i].numIndexWire * size_t(geom.indexSize);
+        offsetSolid += csfgeom->parts[i].numIndexSolid * size_t(geom.indexSize);
+      }
+    }
+  });
+
+  if(config.optimizeVertexCache)
+  {
+    size_t numTriangles = 0;
+    size_t missesBefore = 0;
+    size_t missesAfter  = 0;
+    for(int n = 0; n < numGeoms; n++)
     {
-      memcpy(&indices[csfgeom->numIndexSolid], csfgeom->indexWire, sizeof(unsigned int) * csfgeom->numIndexWire);
+      numTriangles += vertexCacheMissesBefore[n] ? csf->geometries[n].numIndexSolid / 3 : 0;
+      missesBefore += vertexCacheMissesBefore[n];
+      missesAfter += vertexCacheMissesAfter[n];
     }
+    m_loadStats.acmrBefore = numTriangles ? float(double(missesBefore) / double(numTriangles)) : 0.0f;
+    m_loadStats.acmrAfter  = numTriangles ? float(double(missesAfter) / double(numTriangles)) : 0.0f;
+  }
+
+  m_loadStats.timeGeometry = phaseTime();
 
-    geom.iboData = indices;
-    geom.iboSize = sizeof(unsigned int) * (csfgeom->numIndexSolid + csfgeom->numIndexWire);
+  // maps CSF geometry indices to m_geometry
+  std::vector<int> geometryRemap;
+  if(config.deduplicateGeometry)
+  {
+    deduplicateGeometry(numThreads, geometryRemap);
+  }
+  m_loadStats.timeDeduplicate = phaseTime();
 
+  // nodes
+  int numObjects = 0;
+  m_matrices.resize(csf->numNodes);
+  m_animationNodes.resize(csf->numNodes);
+  m_numNodes  = uint32_t(csf->numNodes);
+  m_rootIndex = csf->rootIDX;
 
-    geom.parts.resize(csfgeom->numParts);
+  std::atomic<uint32_t> numNonAffine(0);
 
-    size_t offsetSolid = 0;
-    size_t offsetWire  = csfgeom->numIndexSolid * sizeof(unsigned int);
-    for(int i = 0; i < csfgeom->numParts; i++)
+  ThreadPool::parallelBatches(csf->numNodes, 256, numThreads, [&](size_t begin, size_t end) {
+    for(size_t n = begin; n < end; n++)
     {
-      geom.parts[i].indexWire.count  = csfgeom->parts[i].numIndexWire;
-      geom.parts[i].indexSolid.count = csfgeom->parts[i].numIndexSolid;
+      CSFNode* csfnode = &csf->nodes[n];
 
-      geom.parts[i].indexWire.offset  = offsetWire;
-      geom.parts[i].indexSolid.offset = offsetSolid;
+      memcpy(glm::value_ptr(m_matrices[n].objectMatrix), csfnode->objectTM, sizeof(float) * 16);
+      memcpy(glm::value_ptr(m_matrices[n].worldMatrix), csfnode->worldTM, sizeof(float) * 16);
 
-      offsetWire += csfgeom->parts[i].numIndexWire * sizeof(unsigned int);
-      offsetSolid += csfgeom->parts[i].numIndexSolid * sizeof(unsigned int);
+      m_animationNodes[n].position = glm::vec3(m_matrices[n].worldMatrix[3]);
+      m_animationNodes[n].index    = uint32_t(n);
     }
+
+    // CAD node matrices are almost always affine, those avoid the general 4x4 inverse
+    MatrixNode* nodes       = &m_matrices[begin];
+    size_t      numMatrices = end - begin;
+    size_t      numGeneral  = 0;
+    numGeneral += affineMatrixInverseTranspose(glm::value_ptr(nodes->objectMatrix), sizeof(MatrixNode), numMatrices,
+                                               glm::value_ptr(nodes->objectMatrixIT), sizeof(MatrixNode), matrixPath);
+    numGeneral += affineMatrixInverseTranspose(glm::value_ptr(nodes->worldMatrix), sizeof(MatrixNode), numMatrices,
+                                               glm::value_ptr(nodes->worldMatrixIT), sizeof(MatrixNode), matrixPath);
+    numNonAffine += uint32_t(numGeneral);
+  });
+  m_loadStats.numNonAffineMatrices = numNonAffine;
+
+  // objects are assigned in node order
+  std::vector<int> objectNodes;
+  for(int n = 0; n < csf->numNodes; n++)
+  {
+    if(csf->nodes[n].geometryIDX < 0)
+      continue;
+
+    objectNodes.push_back(n);
   }
-  for(int c = 1; c <= clones; c++)
+  numObjects = int(objectNodes.size());
+
+  m_loadStats.timeNodes = phaseTime();
+
+  // objects
+  m_objects.resize(numObjects);
+
+  // parts and draw range caches live in scene-wide arrays, the spans are assigned up front
+  uint32_t numObjectParts = 0;
+  for(int o = 0; o < numObjects; o++)
   {
-    for(int n = 0; n < numGeoms; n++)
+    m_objects[o].firstPart = numObjectParts;
+    m_objects[o].numParts  = uint32_t(csf->nodes[objectNodes[o]].numParts);
+    numObjectParts += m_objects[o].numParts;
+  }
+  m_objectParts.resize(numObjectParts);
+  allocateDrawCaches();
+
+  std::vector<BBox> objectBboxes(numObjects);
+
+  ThreadPool::parallelBatches(numObjects, 64, numThreads, [&](size_t begin, size_t end) {
+    for(size_t o = begin; o < end; o++)
     {
-      m_geometryBboxes[n + numGeoms * c] = m_geometryBboxes[n];
+      int      n       = objectNodes[o];
+      CSFNode* csfnode = &csf->nodes[n];
 
-      const Geometry& geomorig = m_geometry[n];
-      Geometry&       geom     = m_geometry[n + numGeoms * c];
+      Object& object = m_objects[o];
 
-      geom          = geomorig;
-      geom.cloneIdx = n;
+      object.matrixIndex   = n;
+      object.geometryIndex = geometryRemap.empty() ? csfnode->geometryIDX : geometryRemap[csfnode->geometryIDX];
+
+      ObjectPart* parts = getObjectParts(object);
+      for(int i = 0; i < csfnode->numParts; i++)
+      {
+        parts[i].active        = 1;
+        parts[i].matrixIndex   = csfnode->parts[i].nodeIDX < 0 ? object.matrixIndex : csfnode->parts[i].nodeIDX;
+        parts[i].materialIndex = csfnode->parts[i].materialIDX;
+#if 1
+        if(csf->materials[csfnode->parts[i].materialIDX].color[3] < 0.9f)
+        {
+          parts[i].active = 0;
+        }
+#endif
+      }
+
+      objectBboxes[o] = m_geometryBboxes[object.geometryIndex].transformed(m_matrices[n].worldMatrix);
+
+      // with quantized vertices the matrix indices still change, see createDequantizationMatrices
+      if(!config.quantizedVertices)
+      {
+        updateObjectDrawCache(object);
+      }
     }
+  });
+
+  // min/max merging is order independent
+  for(int o = 0; o < numObjects; o++)
+  {
+    m_bbox.merge(objectBboxes[o]);
   }
 
+  // keep the CSF memory alive while geometry references it
+  size_t sharedIndexBytes = 0;
+  for(const Geometry& geom : m_geometry)
+  {
+    sharedIndexBytes += geom.iboOwned ? 0 : geom.iboSize;
+  }
+  m_loadStats.sharedIndexBytes = sharedIndexBytes;
 
-  // nodes
-  int numObjects = 0;
-  m_matrices.resize(csf->numNodes * copies);
+  if(sharedIndexBytes)
+  {
+    m_csfMemory = mem;
+  }
+  else
+  {
+    CSFileMemory_delete(mem);
+  }
 
-  for(int n = 0; n < csf->numNodes; n++)
+  if(config.quantizedVertices)
+  {
+    createDequantizationMatrices(numThreads);
+  }
+
+  m_loadStats.timeObjects = phaseTime();
+
+  return true;
+}
+
+// inverse-transpose of a matrix whose translation was moved by shift, derived from the original one
+static glm::mat4 shiftedInverseTranspose(const glm::mat4& matrix, const glm::mat4& matrixIT, const glm::vec4& shift)
+{
+  if(matrix[0][3] == 0.0f && matrix[1][3] == 0.0f && matrix[2][3] == 0.0f && matrix[3][3] == 1.0f)
   {
-    CSFNode* csfnode = &csf->nodes[n];
+    // affine: inverse(translate(shift) * M) = inverse(M) * translate(-shift)
+    glm::mat4 inverse = glm::transpose(matrixIT);
+    inverse[3]        = inverse * glm::vec4(-shift.x, -shift.y, -shift.z, 1.0f);
+    return glm::transpose(inverse);
+  }
 
-    memcpy(glm::value_ptr(m_matrices[n].objectMatrix), csfnode->objectTM, sizeof(float) * 16);
-    memcpy(glm::value_ptr(m_matrices[n].worldMatrix), csfnode->worldTM, sizeof(float) * 16);
+  return glm::transpose(glm::inverse(matrix));
+}
 
-    m_matrices[n].objectMatrixIT = glm::transpose(glm::inverse(m_matrices[n].objectMatrix));
-    m_matrices[n].worldMatrixIT  = glm::transpose(glm::inverse(m_matrices[n].worldMatrix));
+static inline void shiftMatrixNode(CadScene::MatrixNode& node, const glm::vec4& shift, bool isRoot)
+{
+  // move all world matrices
+  node.worldMatrix[3] = node.worldMatrix[3] + shift;
+  node.worldMatrixIT  = shiftedInverseTranspose(node.worldMatrix, node.worldMatrixIT, shift);
 
-    if(csfnode->geometryIDX < 0)
-      continue;
+  if(isRoot)
+  {
+    // patch object matrix of root
+    node.objectMatrix[3] = node.objectMatrix[3] + shift;
+    node.objectMatrixIT  = shiftedInverseTranspose(node.objectMatrix, node.objectMatrixIT, shift);
+  }
+}
 
-    numObjects++;
+void CadScene::fillCloneMatrices(uint32_t copy, MatrixNode* matrices) const
+{
+  for(size_t n = 0; n < m_matrices.size(); n++)
+  {
+    matrices[n] = m_matrices[n];
+    if(copy)
+    {
+      shiftMatrixNode(matrices[n], m_cloneShifts[copy], int(n) == m_rootIndex);
+    }
   }
+}
 
+void CadScene::fillCloneAnimationNodes(uint32_t copy, AnimationNode* nodes) const
+{
+  for(size_t n = 0; n < m_animationNodes.size(); n++)
+  {
+    nodes[n] = m_animationNodes[n];
+    nodes[n].position += glm::vec3(m_cloneShifts[copy]);
+    nodes[n].index += copy * m_numNodes;
+  }
+}
 
-  // objects
-  m_objects.resize(numObjects * copies);
-  numObjects = 0;
-  for(int n = 0; n < csf->numNodes; n++)
+// FNV-1a, same as CadScene::hashFile but continuing from a previous hash
+static uint64_t hashBytes(uint64_t h, const void* data, size_t size)
+{
+  const uint64_t prime = 0x100000001b3ull;
+  const uint8_t* bytes = (const uint8_t*)data;
+
+  size_t numWords = size / sizeof(uint64_t);
+  for(size_t i = 0; i < numWords; i++)
   {
-    CSFNode* csfnode = &csf->nodes[n];
+    uint64_t word;
+    memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+    h = (h ^ word) * prime;
+  }
+  for(size_t i = numWords * sizeof(uint64_t); i < size; i++)
+  {
+    h = (h ^ bytes[i]) * prime;
+  }
+  return h;
+}
 
-    if(csfnode->geometryIDX < 0)
-      continue;
+static bool isSameGeometry(const CadScene::Geometry& a, const CadScene::Geometry& b)
+{
+  if(a.numVertices != b.numVertices || a.numIndexSolid != b.numIndexSolid || a.numIndexWire != b.numIndexWire
+     || a.indexSize != b.indexSize || a.vboSize != b.vboSize || a.iboSize != b.iboSize || a.numParts != b.numParts)
+  {
+    return false;
+  }
 
-    Object& object = m_objects[numObjects];
+  for(int i = 0; i < a.numParts; i++)
+  {
+    const CadScene::GeometryPart& pa = a.parts[i];
+    const CadScene::GeometryPart& pb = b.parts[i];
+    if(pa.indexSolid.offset != pb.indexSolid.offset || pa.indexSolid.count != pb.indexSolid.count
+       || pa.indexWire.offset != pb.indexWire.offset || pa.indexWire.count != pb.indexWire.count)
+    {
+      return false;
+    }
+  }
 
-    object.matrixIndex   = n;
-    object.geometryIndex = csfnode->geometryIDX;
+  return memcmp(a.vboData, b.vboData, a.vboSize) == 0 && memcmp(a.iboData, b.iboData, a.iboSize) == 0;
+}
 
-    object.parts.resize(csfnode->numParts);
-    for(int i = 0; i < csfnode->numParts; i++)
+void CadScene::deduplicateGeometry(uint32_t numThreads, std::vector<int>& remap)
+{
+  // CAD exports often store the same part (screws, bolts...) as separate geometries.
+  // Duplicates are detected by a content hash and confirmed byte-wise, the first
+  // occurrence is kept so the result does not depend on the thread count.
+  size_t numGeoms = m_geometry.size();
+
+  std::vector<uint64_t> hashes(numGeoms);
+  ThreadPool::parallelBatches(numGeoms, 16, numThreads, [&](size_t begin, size_t end) {
+    for(size_t n = begin; n < end; n++)
     {
-      object.parts[i].active        = 1;
-      object.parts[i].matrixIndex   = csfnode->parts[i].nodeIDX < 0 ? object.matrixIndex : csfnode->parts[i].nodeIDX;
-      object.parts[i].materialIndex = csfnode->parts[i].materialIDX;
-#if 1
-      if(csf->materials[csfnode->parts[i].materialIDX].color[3] < 0.9f)
+      const Geometry& geom = m_geometry[n];
+
+      uint64_t h = 0xcbf29ce484222325ull;
+      h          = hashBytes(h, &geom.numVertices, sizeof(geom.numVertices));
+      h          = hashBytes(h, &geom.numIndexSolid, sizeof(geom.numIndexSolid));
+      h          = hashBytes(h, &geom.numIndexWire, sizeof(geom.numIndexWire));
+      for(int i = 0; i < geom.numParts; i++)
       {
-        object.parts[i].active = 0;
+        h = hashBytes(h, &geom.parts[i].indexSolid.count, sizeof(geom.parts[i].indexSolid.count));
+        h = hashBytes(h, &geom.parts[i].indexWire.count, sizeof(geom.parts[i].indexWire.count));
       }
-#endif
+      if(m_quantizedVertices)
+      {
+        h = hashBytes(h, &m_geometryBboxes[n], sizeof(BBox));
+      }
+      h         = hashBytes(h, geom.vboData, geom.vboSize);
+      hashes[n] = hashBytes(h, geom.iboData, geom.iboSize);
     }
+  });
+
+  // hash -> unique geometries with that hash, collisions are resolved by the byte-wise compare
+  std::unordered_map<uint64_t, std::vector<int>> uniques;
+  std::vector<Geometry>                          geometry;
+  std::vector<BBox>                              geometryBboxes;
 
-    BBox bbox = m_geometryBboxes[object.geometryIndex].transformed(m_matrices[n].worldMatrix);
-    m_bbox.merge(bbox);
+  size_t duplicateBytes = 0;
+
+  remap.resize(numGeoms);
+  for(size_t n = 0; n < numGeoms; n++)
+  {
+    std::vector<int>& candidates = uniques[hashes[n]];
 
-    updateObjectDrawCache(object);
+    int found = -1;
+    for(int candidate : candidates)
+    {
+      // quantized positions are relative to the bbox, equal bytes can still be different meshes
+      if(m_quantizedVertices && memcmp(&geometryBboxes[candidate], &m_geometryBboxes[n], sizeof(BBox)) != 0)
+        continue;
+
+      if(isSameGeometry(geometry[candidate], m_geometry[n]))
+      {
+        found = candidate;
+        break;
+      }
+    }
 
-    numObjects++;
+    if(found >= 0)
+    {
+      remap[n] = found;
+      // the arena memory of the duplicate stays allocated until unload, but it is not uploaded
+      duplicateBytes += m_geometry[n].vboSize + m_geometry[n].iboSize;
+    }
+    else
+    {
+      remap[n] = int(geometry.size());
+      candidates.push_back(remap[n]);
+      geometry.push_back(std::move(m_geometry[n]));
+      geometryBboxes.push_back(m_geometryBboxes[n]);
+    }
   }
 
+  m_loadStats.numDuplicateGeometries = uint32_t(numGeoms - geometry.size());
+  m_loadStats.duplicateGeometryBytes = duplicateBytes;
+
+  m_geometry       = std::move(geometry);
+  m_geometryBboxes = std::move(geometryBboxes);
+}
+
+void CadScene::createDequantizationMatrices(uint32_t numThreads)
+{
+  // Quantized positions need the geometry's bbox applied as scale and bias in front of the world matrix.
+  // The first geometry drawn with a matrix patches it in place, every further geometry that shares the
+  // matrix gets an appended copy. The inverse-transpose matrices are left as is, normals are not quantized.
+  // Copies keep the animation node of their source, so that the animation moves them together.
+  size_t numNodes = m_matrices.size();
+
+  std::vector<int>                  matrixGeometry(numNodes, -1);
+  std::vector<int>                  appendedSource;
+  std::unordered_map<uint64_t, int> pairs;
+
+  auto getMatrix = [&](int matrixIndex, int geometryIndex) {
+    if(matrixGeometry[matrixIndex] < 0)
+    {
+      matrixGeometry[matrixIndex] = geometryIndex;
+    }
+    if(matrixGeometry[matrixIndex] == geometryIndex)
+    {
+      return matrixIndex;
+    }
+
+    uint64_t key = (uint64_t(matrixIndex) << 32) | uint32_t(geometryIndex);
+    auto     it  = pairs.find(key);
+    if(it != pairs.end())
+    {
+      return it->second;
+    }
+
+    int index = int(matrixGeometry.size());
+    matrixGeometry.push_back(geometryIndex);
+    appendedSource.push_back(matrixIndex);
+    pairs.insert({key, index});
+    return index;
+  };
+
+  // serial, so that the matrix order does not depend on the thread count
+  for(Object& object : m_objects)
+  {
+    object.matrixIndex = getMatrix(object.matrixIndex, object.geometryIndex);
+
+    ObjectPart* parts = getObjectParts(object);
+    for(uint32_t i = 0; i < object.numParts; i++)
+    {
+      parts[i].matrixIndex = getMatrix(parts[i].matrixIndex, object.geometryIndex);
+    }
+  }
+
+  m_matrices.resize(matrixGeometry.size());
+  m_animationNodes.resize(matrixGeometry.size());
+  for(size_t i = 0; i < appendedSource.size(); i++)
+  {
+    m_matrices[numNodes + i]       = m_matrices[appendedSource[i]];
+    m_animationNodes[numNodes + i] = m_animationNodes[appendedSource[i]];
+  }
+  m_loadStats.numDequantizationMatrices = uint32_t(appendedSource.size());
+
+  ThreadPool::parallelBatches(m_matrices.size(), 256, numThreads, [&](size_t begin, size_t end) {
+    for(size_t n = begin; n < end; n++)
+    {
+      if(matrixGeometry[n] < 0)
+        continue;
+
+      const BBox& bbox    = m_geometryBboxes[matrixGeometry[n]];
+      glm::mat4   dequant = glm::mat4(1);
+      dequant[0][0]       = (bbox.max.x - bbox.min.x) / 65535.0f;
+      dequant[1][1]       = (bbox.max.y - bbox.min.y) / 65535.0f;
+      dequant[2][2]       = (bbox.max.z - bbox.min.z) / 65535.0f;
+      dequant[3]          = glm::vec4(glm::vec3(bbox.min), 1.0f);
+
+      MatrixNode& node  = m_matrices[n];
+      node.worldMatrix  = node.worldMatrix * dequant;
+      node.objectMatrix = node.objectMatrix * dequant;
+    }
+  });
+
+  ThreadPool::parallelBatches(m_objects.size(), 64, numThreads, [&](size_t begin, size_t end) {
+    for(size_t o = begin; o < end; o++)
+    {
+      updateObjectDrawCache(m_objects[o]);
+    }
+  });
+}
+
+void CadScene::createClones(int clones, int cloneaxis, bool instanced)
+{
+  int copies = clones + 1;
+
   // compute clone move delta based on m_bbox;
 
   glm::vec4 dim = m_bbox.max - m_bbox.min;
@@ -315,10 +801,11 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
   }
 
 
+  m_cloneShifts.resize(copies);
+  m_cloneShifts[0] = glm::vec4(0);
+
   for(int c = 1; c <= clones; c++)
   {
-    int numNodes = csf->numNodes;
-
     glm::vec4 shift = dim * 1.05f;
 
     float u = 0;
@@ -378,21 +865,58 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
 
     shift.w = 0;
 
-    // move all world matrices
-    for(int n = 0; n < numNodes; n++)
+    m_cloneShifts[c] = shift;
+  }
+
+  m_cloneInstancing = instanced;
+  if(instanced || !clones)
+    return;
+
+  // duplicate the base scene for every copy
+  int    numGeoms   = int(m_geometry.size());
+  int    numNodes   = int(m_matrices.size());
+  int    numObjects = int(m_objects.size());
+  size_t numParts   = m_objectParts.size();
+  size_t numSlots   = m_drawStates.size();
+
+  m_geometry.resize(numGeoms * copies);
+  m_geometryBboxes.resize(numGeoms * copies);
+  m_matrices.resize(numNodes * copies);
+  m_animationNodes.resize(numNodes * copies);
+  m_objects.resize(numObjects * copies);
+  m_objectParts.resize(numParts * copies);
+  m_drawStates.resize(numSlots * copies);
+  m_drawStateCounts.resize(numSlots * copies);
+  m_drawOffsets.resize(numSlots * copies);
+  m_drawCounts.resize(numSlots * copies);
+
+  for(int c = 1; c <= clones; c++)
+  {
+    for(int n = 0; n < numGeoms; n++)
     {
-      MatrixNode& node     = m_matrices[n + numNodes * c];
-      MatrixNode& nodeOrig = m_matrices[n];
-      node                 = nodeOrig;
-      node.worldMatrix[3]  = node.worldMatrix[3] + shift;
-      node.worldMatrixIT   = glm::transpose(glm::inverse(node.worldMatrix));
+      m_geometryBboxes[n + numGeoms * c] = m_geometryBboxes[n];
+
+      const Geometry& geomorig = m_geometry[n];
+      Geometry&       geom     = m_geometry[n + numGeoms * c];
+
+      geom          = geomorig;
+      geom.cloneIdx = n;
     }
 
+    ThreadPool::parallelBatches(numNodes, 256, m_loadStats.numThreads, [&](size_t begin, size_t end) {
+      for(size_t n = begin; n < end; n++)
+      {
+        MatrixNode& node = m_matrices[n + numNodes * c];
+        node             = m_matrices[n];
+        shiftMatrixNode(node, m_cloneShifts[c], int(n) == m_rootIndex);
+      }
+    });
+    for(int n = 0; n < numNodes; n++)
     {
-      // patch object matrix of root
-      MatrixNode& node     = m_matrices[csf->rootIDX + numNodes * c];
-      node.objectMatrix[3] = node.objectMatrix[3] + shift;
-      node.objectMatrixIT  = glm::transpose(glm::inverse(node.objectMatrix));
+      AnimationNode& node = m_animationNodes[n + numNodes * c];
+      node                = m_animationNodes[n];
+      node.position += glm::vec3(m_cloneShifts[c]);
+      node.index += c * m_numNodes;
     }
 
     // clone objects
@@ -404,24 +928,31 @@ bool CadScene::loadCSF(const char* filename, int clones, int cloneaxis)
       object = objectorig;
       object.geometryIndex += c * numGeoms;
       object.matrixIndex += c * numNodes;
-      for(size_t i = 0; i < object.parts.size(); i++)
-      {
-        object.parts[i].matrixIndex += c * numNodes;
-      }
+      object.firstPart += uint32_t(c * numParts);
+      object.cacheSolid.begin += uint32_t(c * numSlots);
+      object.cacheWire.begin += uint32_t(c * numSlots);
+    }
 
-      for(size_t i = 0; i < object.cacheSolid.state.size(); i++)
-      {
-        object.cacheSolid.state[i].matrixIndex += c * numNodes;
-      }
-      for(size_t i = 0; i < object.cacheWire.state.size(); i++)
-      {
-        object.cacheWire.state[i].matrixIndex += c * numNodes;
-      }
+    // the spans of the copies keep the base layout, so the arrays are copied as a whole
+    for(size_t i = 0; i < numParts; i++)
+    {
+      ObjectPart& part = m_objectParts[i + numParts * c];
+      part             = m_objectParts[i];
+      part.matrixIndex += c * numNodes;
+    }
+
+    for(size_t i = 0; i < numSlots; i++)
+    {
+      DrawStateInfo& state = m_drawStates[i + numSlots * c];
+      state                = m_drawStates[i];
+      state.matrixIndex += c * numNodes;
     }
+    std::copy(m_drawStateCounts.begin(), m_drawStateCounts.begin() + numSlots, m_drawStateCounts.begin() + numSlots * c);
+    std::copy(m_drawOffsets.begin(), m_drawOffsets.begin() + numSlots, m_drawOffsets.begin() + numSlots * c);
+    std::copy(m_drawCounts.begin(), m_drawCounts.begin() + numSlots, m_drawCounts.begin() + numSlots * c);
   }
 
-  CSFileMemory_delete(mem);
-  return true;
+  m_numNodes *= uint32_t(copies);
 }
 
 
@@ -441,13 +972,20 @@ static bool ListItem_compare(const ListItem& a, const ListItem& b)
   return diff < 0;
 }
 
-static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListItem>& list)
+// writes the ranges of the sorted list to the slot at cache.begin, which has room for one state and range per list item
+static void fillCache(CadScene& scene, CadScene::DrawRangeCache& cache, const std::vector<ListItem>& list, size_t indexSize)
 {
-  cache = CadScene::DrawRangeCache();
+  cache.numStates = 0;
+  cache.numRanges = 0;
 
   if(!list.size())
     return;
 
+  CadScene::DrawStateInfo* states      = scene.m_drawStates.data() + cache.begin;
+  int*                     stateCounts = scene.m_drawStateCounts.data() + cache.begin;
+  size_t*                  offsets     = scene.m_drawOffsets.data() + cache.begin;
+  int*                     counts      = scene.m_drawCounts.data() + cache.begin;
+
   CadScene::DrawStateInfo state = list[0].state;
   CadScene::DrawRange     range = list[0].range;
 
@@ -462,15 +1000,17 @@ static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListIte
       if(range.count)
       {
         stateCount++;
-        cache.offsets.push_back(range.offset);
-        cache.counts.push_back(range.count);
+        offsets[cache.numRanges] = range.offset;
+        counts[cache.numRanges]  = range.count;
+        cache.numRanges++;
       }
 
       // emit
       if(stateCount)
       {
-        cache.state.push_back(state);
-        cache.stateCount.push_back(stateCount);
+        states[cache.numStates]      = state;
+        stateCounts[cache.numStates] = stateCount;
+        cache.numStates++;
       }
 
       stateCount = 0;
@@ -489,7 +1029,7 @@ static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListIte
     }
 
     const CadScene::DrawRange& currange = list[i].range;
-    if(newrange || (USE_CACHECOMBINE && currange.offset == (range.offset + sizeof(unsigned int) * range.count)))
+    if(newrange || (USE_CACHECOMBINE && currange.offset == (range.offset + indexSize * range.count)))
     {
       // merge
       range.count += currange.count;
@@ -500,8 +1040,9 @@ static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListIte
       if(range.count)
       {
         stateCount++;
-        cache.offsets.push_back(range.offset);
-        cache.counts.push_back(range.count);
+        offsets[cache.numRanges] = range.offset;
+        counts[cache.numRanges]  = range.count;
+        cache.numRanges++;
       }
 
       range = currange;
@@ -509,38 +1050,68 @@ static void fillCache(CadScene::DrawRangeCache& cache, const std::vector<ListIte
   }
 }
 
+void CadScene::allocateDrawCaches()
+{
+  size_t numSlots = m_objectParts.size() * 2;
+  m_drawStates.resize(numSlots);
+  m_drawStateCounts.resize(numSlots);
+  m_drawOffsets.resize(numSlots);
+  m_drawCounts.resize(numSlots);
+}
+
 void CadScene::updateObjectDrawCache(Object& object)
 {
-  Geometry& geom = m_geometry[object.geometryIndex];
+  Geometry&         geom  = m_geometry[object.geometryIndex];
+  const ObjectPart* parts = getObjectParts(object);
 
   std::vector<ListItem> listSolid;
   std::vector<ListItem> listWire;
 
-  listSolid.reserve(geom.parts.size());
-  listWire.reserve(geom.parts.size());
+  listSolid.reserve(geom.numParts);
+  listWire.reserve(geom.numParts);
 
-  for(size_t i = 0; i < geom.parts.size(); i++)
+  for(int i = 0; i < geom.numParts; i++)
   {
-    if(!object.parts[i].active)
+    if(!parts[i].active)
       continue;
 
     ListItem item;
-    item.state.materialIndex = object.parts[i].materialIndex;
+    item.state.materialIndex = parts[i].materialIndex;
 
     item.range             = geom.parts[i].indexSolid;
-    item.state.matrixIndex = object.parts[i].matrixIndex;
+    item.state.matrixIndex = parts[i].matrixIndex;
     listSolid.push_back(item);
 
     item.range             = geom.parts[i].indexWire;
-    item.state.matrixIndex = object.parts[i].matrixIndex;
+    item.state.matrixIndex = parts[i].matrixIndex;
     listWire.push_back(item);
   }
 
   std::sort(listSolid.begin(), listSolid.end(), ListItem_compare);
   std::sort(listWire.begin(), listWire.end(), ListItem_compare);
 
-  fillCache(object.cacheSolid, listSolid);
-  fillCache(object.cacheWire, listWire);
+  object.cacheSolid.begin = object.firstPart * 2;
+  object.cacheWire.begin  = object.firstPart * 2 + object.numParts;
+
+  fillCache(*this, object.cacheSolid, listSolid, geom.indexSize);
+  fillCache(*this, object.cacheWire, listWire, geom.indexSize);
+}
+
+bool CadScene::setPartActive(uint32_t objectIndex, uint32_t partIndex, bool active)
+{
+  Object& object = m_objects[objectIndex];
+  assert(partIndex < object.numParts);
+
+  ObjectPart& part = getObjectParts(object)[partIndex];
+  if((part.active != 0) == active)
+    return false;
+
+  part.active = active ? 1 : 0;
+
+  // the object's cache slots are fixed, so the rebuild stays in place
+  updateObjectDrawCache(object);
+
+  return true;
 }
 
 void CadScene::unload()
@@ -549,20 +1120,32 @@ void CadScene::unload()
     return;
 
 
-  for(size_t i = 0; i < m_geometry.size(); i++)
-  {
-    if(m_geometry[i].cloneIdx >= 0)
-      continue;
+  // all geometry data that is not referenced in place comes from the arena
+  m_arena.reset();
 
-    delete[] m_geometry[i].vboData;
-    delete[] m_geometry[i].iboData;
+  if(m_csfMemory)
+  {
+    CSFileMemory_delete(m_csfMemory);
+    m_csfMemory = nullptr;
   }
+  m_cacheMapping.close();
 
   m_matrices.clear();
+  m_animationNodes.clear();
+  m_numNodes = 0;
   m_geometryBboxes.clear();
   m_geometry.clear();
   m_objects.clear();
+  m_objectParts.clear();
+  m_drawStates.clear();
+  m_drawStateCounts.clear();
+  m_drawOffsets.clear();
+  m_drawCounts.clear();
   m_geometryBboxes.clear();
+  m_cloneShifts.clear();
+  m_cloneInstancing   = false;
+  m_quantizedVertices = false;
+  m_bbox              = BBox();
 }
 
 CadScene::IndexingBits CadScene::getIndexingBits() const
@@ -572,7 +1155,7 @@ CadScene::IndexingBits CadScene::getIndexingBits() const
   for(uint32_t i = 32; i >= 1; i--)
   {
     uint64_t max = uint64_t(1) << i;
-    if(m_matrices.size() < max)
+    if(getNumMatrices() < max)
     {
       bits.matrices = i;
     }
@@ -23,9 +23,13 @@
 
 #include <cstring>  // memset
 #include <glm/glm.hpp>
+#include <nvh/filemapping.hpp>
+#include "memoryarena.hpp"
 #include <vector>
 #include <cstdint>
 
+struct CSFileMemory_s;
+
 class CadScene
 {
 
@@ -116,6 +120,14 @@ public:
     glm::mat4 objectMatrixIT;
   };
 
+  // must match common.h, one per matrix
+  struct AnimationNode
+  {
+    // world translation of the node, without the dequantization of quantized vertices
+    glm::vec3 position;
+    uint32_t  index;
+  };
+
   struct Vertex
   {
     glm::vec3 position;
@@ -123,6 +135,16 @@ public:
     uint16_t  normalOctY;
   };
 
+  // used instead of Vertex with LoadConfig::quantizedVertices
+  struct VertexQuantized
+  {
+    // unorm16 within the geometry's bbox, the matrices used with the geometry
+    // contain the dequantization
+    uint16_t position[3];
+    int8_t   normalOctX;
+    int8_t   normalOctY;
+  };
+
   struct DrawRange
   {
     size_t offset;
@@ -151,13 +173,14 @@ public:
     }
   };
 
+  // Span within the scene-wide m_drawStates/m_drawStateCounts and m_drawOffsets/m_drawCounts.
+  // Every state has stateCount consecutive ranges. States and ranges start at the same
+  // slot, an object reserves numParts slots each for its solid and wire cache.
   struct DrawRangeCache
   {
-    std::vector<DrawStateInfo> state;
-    std::vector<int>           stateCount;
-
-    std::vector<size_t> offsets;
-    std::vector<int>    counts;
+    uint32_t begin     = 0;
+    uint32_t numStates = 0;
+    uint32_t numRanges = 0;
   };
 
   struct GeometryPart
@@ -172,14 +195,28 @@ public:
     size_t vboSize;
     size_t iboSize;
 
-    Vertex*       vboData;
-    unsigned int* iboData;
+    // Vertex or VertexQuantized, see m_quantizedVertices
+    void* vboData;
+    // uint16_t indices when indexSize is 2, uint32_t otherwise
+    void*    iboData;
+    uint32_t indexSize = sizeof(uint32_t);
+
+    // false when the data references the CSF file memory or scene cache rather than m_arena
+    bool vboOwned = true;
+    bool iboOwned = true;
 
-    std::vector<GeometryPart> parts;
+    // allocated from m_arena
+    GeometryPart* parts    = nullptr;
+    int           numParts = 0;
 
     int numVertices;
     int numIndexSolid;
     int numIndexWire;
+
+    uint32_t getIndex(size_t i) const
+    {
+      return indexSize == sizeof(uint16_t) ? ((const uint16_t*)iboData)[i] : ((const uint32_t*)iboData)[i];
+    }
   };
 
   struct ObjectPart
@@ -194,7 +231,9 @@ public:
     int matrixIndex;
     int geometryIndex;
 
-    std::vector<ObjectPart> parts;
+    // span within m_objectParts, matches the geometry's parts
+    uint32_t firstPart = 0;
+    uint32_t numParts  = 0;
 
     DrawRangeCache cacheSolid;
     DrawRangeCache cacheWire;
@@ -206,15 +245,153 @@ public:
   std::vector<MatrixNode> m_matrices;
   std::vector<Object>     m_objects;
 
+  // node of every matrix, dequantization matrices are appended after the m_numNodes node matrices
+  std::vector<AnimationNode> m_animationNodes;
+  uint32_t                   m_numNodes = 0;
+
+  // parts of all objects
+  std::vector<ObjectPart> m_objectParts;
+
+  // draw range caches of all objects, two slots per object part
+  std::vector<DrawStateInfo> m_drawStates;
+  std::vector<int>           m_drawStateCounts;
+  std::vector<size_t>        m_drawOffsets;
+  std::vector<int>           m_drawCounts;
+
+  const ObjectPart* getObjectParts(const Object& object) const { return m_objectParts.data() + object.firstPart; }
+  ObjectPart*       getObjectParts(const Object& object) { return m_objectParts.data() + object.firstPart; }
+
 
   BBox m_bbox;
+  int  m_rootIndex = 0;
+
+  // World-space translation of every copy, [0] is the original scene.
+  // With clone instancing only the base scene is stored, copy c uses the
+  // objects of the base scene with matrix indices offset by c * m_matrices.size(),
+  // the matrices themselves are generated via fillCloneMatrices.
+  std::vector<glm::vec4> m_cloneShifts;
+  bool                   m_cloneInstancing = false;
+
+  uint32_t getNumCopies() const { return m_cloneInstancing ? uint32_t(m_cloneShifts.size()) : 1; }
+  size_t   getNumObjects() const { return m_objects.size() * getNumCopies(); }
+  size_t   getNumMatrices() const { return m_matrices.size() * getNumCopies(); }
+  size_t   getNumNodes() const { return size_t(m_numNodes) * getNumCopies(); }
+  // writes the m_matrices.size() matrices of the given copy
+  void fillCloneMatrices(uint32_t copy, MatrixNode* matrices) const;
+  // writes the m_animationNodes.size() animation nodes of the given copy
+  void fillCloneAnimationNodes(uint32_t copy, AnimationNode* nodes) const;
+
+  // all geometry uses VertexQuantized
+  bool m_quantizedVertices = false;
+
+  size_t getVertexSize() const { return m_quantizedVertices ? sizeof(VertexQuantized) : sizeof(Vertex); }
+
+  // geometry vertex, index and part data, released as a whole by unload
+  MemoryArena m_arena;
+  // when loaded from the scene cache, geometry vertex and index data point into this mapping
+  nvh::FileReadMapping m_cacheMapping;
+  // kept alive when geometry index data references the loaded CSF file directly
+  CSFileMemory_s* m_csfMemory = nullptr;
+
+
+  struct LoadConfig
+  {
+    // 0 uses all physical cores, 1 loads serially
+    uint32_t numThreads = 0;
+    // encode normals with the widest SIMD path available, results are identical to scalar
+    bool simdNormals = true;
+    // invert affine node matrices with the widest SIMD path available, results are identical to scalar
+    bool simdMatrices = true;
+    // reference the index data of the CSF file in place rather than copying it,
+    // the file memory then stays alive with the scene
+    bool zeroCopyIndices = true;
+    // store the indices of geometries with at most 65536 vertices as 16-bit,
+    // these are always copied
+    bool shortIndices = true;
+    // store positions as 16-bit relative to the geometry bbox with an 8-bit oct normal,
+    // geometries drawn with the same matrix get their own copy of it
+    bool quantizedVertices = false;
+    // reorder the triangles of every part for post-transform cache locality
+    // and the vertices in order of first use, the optimized indices are always copied
+    bool optimizeVertexCache = false;
+    // merge geometries with identical vertex and index data into one,
+    // changes the geometry count and therefore the draw state sort keys
+    bool deduplicateGeometry = false;
+    // advise the kernel to back the scene memory arena with transparent huge pages (Linux only)
+    bool hugePages = true;
+    // keep a single base scene plus per-copy shifts instead of duplicating the scene for clones
+    bool cloneInstancing = false;
+    // memory-map the preprocessed scene from "<filename>.csfcache",
+    // the cache is (re-)written next to the model when missing or the source file changed
+    bool useCache = false;
+  };
 
+  // timings are in milliseconds
+  struct LoadStats
+  {
+    enum CacheState
+    {
+      CACHE_DISABLED,
+      CACHE_MISS,
+      CACHE_WRITTEN,
+      CACHE_LOADED,
+    };
+
+    CacheState cacheState = CACHE_DISABLED;
+
+    uint32_t numThreads                = 0;
+    uint32_t numShortIndexGeometries   = 0;
+    uint32_t numDequantizationMatrices = 0;
+    uint32_t numDuplicateGeometries    = 0;
+    // node matrices (object and world) that needed a general 4x4 inverse
+    uint32_t numNonAffineMatrices = 0;
+    size_t   sharedIndexBytes          = 0;
+    // vertex and index memory of the removed duplicates
+    size_t duplicateGeometryBytes = 0;
+    // average cache miss ratio of the solid triangles, see vertexcache.hpp
+    float acmrBefore = 0;
+    float acmrAfter  = 0;
+    // index memory saved by 16-bit indices
+    size_t shortIndexSavedBytes = 0;
+    // m_arena usage after loading
+    MemoryArena::Stats arena;
+
+    double timeCache       = 0;
+    double timeFile        = 0;
+    double timeMaterials   = 0;
+    double timeGeometry    = 0;
+    double timeDeduplicate = 0;
+    double timeNodes       = 0;
+    double timeObjects     = 0;
+    double timeClones      = 0;
+    double timeTotal       = 0;
+  };
 
-  void updateObjectDrawCache(Object& object);
+  LoadStats m_loadStats;
 
-  bool loadCSF(const char* filename, int clones = 0, int cloneaxis = 3);
+
+  // m_objectParts and the draw range arrays must cover the object's parts
+  void updateObjectDrawCache(Object& object);
+  // sizes the draw range arrays for m_objectParts
+  void allocateDrawCaches();
+  // toggles a single part and rebuilds only the draw caches of its object,
+  // returns false if the part was already in that state.
+  // Renderers patch their draw items via Renderer::updateParts afterwards.
+  bool setPartActive(uint32_t objectIndex, uint32_t partIndex, bool active);
+
+  bool loadCSF(const char* filename, const LoadConfig& config, int clones = 0, int cloneaxis = 3);
+  bool loadCSFScene(const char* filename, const LoadConfig& config);
+  void createClones(int clones, int cloneaxis, bool instanced);
+  void createDequantizationMatrices(uint32_t numThreads);
+  // removes duplicate geometries, remap receives the new index of every old geometry
+  void deduplicateGeometry(uint32_t numThreads, std::vector<int>& remap);
   void unload();
 
+  // scene cache, see cadscene_cache.cpp
+  static bool hashFile(const char* filename, uint64_t& hash, uint64_t& size);
+  bool        loadCache(const char* filename, uint64_t sourceHash, uint64_t sourceSize, const LoadConfig& config);
+  bool        saveCache(const char* filename, uint64_t sourceHash, uint64_t sourceSize, const LoadConfig& config) const;
+
   struct IndexingBits
   {
     uint32_t matrices  = 0;
@@ -0,0 +1,662 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "cadscene.hpp"
+#include <nvh/nvprint.hpp>
+
+#include <cstdio>
+#include <string>
+
+// The scene cache stores the fully converted base scene (before cloning).
+// Vertex and index data are referenced in place from the memory-mapped file,
+// the remaining tables are small and copied into the regular containers.
+//
+// Bump the version whenever the layout or the content produced by
+// CadScene::loadCSFScene changes.
+
+#define CADSCENE_CACHE_VERSION 8
+
+static const char CADSCENE_CACHE_MAGIC[8] = {'C', 'S', 'F', 'C', 'A', 'C', 'H', 'E'};
+
+// load options that change the cached content, a cache only matches the same options
+enum CacheContentFlag
+{
+  CACHE_CONTENT_SHORT_INDICES          = 1 << 0,
+  CACHE_CONTENT_QUANTIZED_VERTICES     = 1 << 1,
+  CACHE_CONTENT_OPTIMIZED_VERTEX_CACHE = 1 << 2,
+  CACHE_CONTENT_DEDUPLICATED_GEOMETRY  = 1 << 3,
+};
+
+static uint32_t getContentFlags(const CadScene::LoadConfig& config)
+{
+  uint32_t flags = 0;
+  flags |= config.shortIndices ? CACHE_CONTENT_SHORT_INDICES : 0;
+  flags |= config.quantizedVertices ? CACHE_CONTENT_QUANTIZED_VERTICES : 0;
+  flags |= config.optimizeVertexCache ? CACHE_CONTENT_OPTIMIZED_VERTEX_CACHE : 0;
+  flags |= config.deduplicateGeometry ? CACHE_CONTENT_DEDUPLICATED_GEOMETRY : 0;
+  return flags;
+}
+
+enum CacheSection
+{
+  SECTION_MATERIALS,
+  SECTION_MATRICES,
+  SECTION_ANIMATION_NODES,
+  SECTION_GEOMETRY_BBOXES,
+  SECTION_GEOMETRIES,
+  SECTION_GEOMETRY_PARTS,
+  SECTION_OBJECTS,
+  SECTION_OBJECT_PARTS,
+  SECTION_DRAW_STATES,
+  SECTION_DRAW_STATE_COUNTS,
+  SECTION_DRAW_OFFSETS,
+  SECTION_DRAW_COUNTS,
+  SECTION_VERTICES,
+  SECTION_INDICES,
+  NUM_SECTIONS,
+};
+
+struct CacheSectionInfo
+{
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct CacheHeader
+{
+  char     magic[8];
+  uint32_t version;
+  uint32_t vertexSize;
+  uint64_t sourceHash;
+  uint64_t sourceSize;
+  uint64_t fileSize;
+
+  int32_t  rootIndex;
+  uint32_t contentFlags;
+  uint32_t numDequantizationMatrices;
+  float    acmrBefore;
+  float    acmrAfter;
+  uint32_t numDuplicateGeometries;
+  uint64_t duplicateGeometryBytes;
+  uint32_t numNonAffineMatrices;
+  int32_t  _pad;
+
+  CadScene::BBox bbox;
+
+  CacheSectionInfo sections[NUM_SECTIONS];
+};
+
+struct CacheGeometry
+{
+  uint64_t firstVertex;
+  uint64_t indexByteOffset;
+  uint64_t firstPart;
+  int32_t  numVertices;
+  int32_t  numIndexSolid;
+  int32_t  numIndexWire;
+  int32_t  numParts;
+  uint32_t indexSize;
+  int32_t  _pad;
+};
+
+struct CacheGeometryPart
+{
+  uint64_t solidOffset;
+  uint64_t wireOffset;
+  int32_t  solidCount;
+  int32_t  wireCount;
+};
+
+// the object part and draw range sections are the scene-wide arrays as is,
+// so the spans are stored unchanged
+struct CacheDrawRangeCache
+{
+  uint32_t begin;
+  uint32_t numStates;
+  uint32_t numRanges;
+  uint32_t _pad;
+};
+
+struct CacheObject
+{
+  int32_t             matrixIndex;
+  int32_t             geometryIndex;
+  uint32_t            firstPart;
+  uint32_t            numParts;
+  CacheDrawRangeCache cacheSolid;
+  CacheDrawRangeCache cacheWire;
+};
+
+static const size_t s_sectionElementSize[NUM_SECTIONS] = {
+    sizeof(CadScene::Material),       // SECTION_MATERIALS
+    sizeof(CadScene::MatrixNode),     // SECTION_MATRICES
+    sizeof(CadScene::AnimationNode),  // SECTION_ANIMATION_NODES
+    sizeof(CadScene::BBox),           // SECTION_GEOMETRY_BBOXES
+    sizeof(CacheGeometry),            // SECTION_GEOMETRIES
+    sizeof(CacheGeometryPart),        // SECTION_GEOMETRY_PARTS
+    sizeof(CacheObject),              // SECTION_OBJECTS
+    sizeof(CadScene::ObjectPart),     // SECTION_OBJECT_PARTS
+    sizeof(CadScene::DrawStateInfo),  // SECTION_DRAW_STATES
+    sizeof(int32_t),                  // SECTION_DRAW_STATE_COUNTS
+    sizeof(uint64_t),                 // SECTION_DRAW_OFFSETS
+    sizeof(int32_t),                  // SECTION_DRAW_COUNTS
+    sizeof(uint8_t),                  // SECTION_VERTICES, header.vertexSize each
+    sizeof(uint8_t),                  // SECTION_INDICES, mixed 16 and 32-bit
+};
+
+// keeps 32-bit index data of every geometry aligned
+static inline uint64_t alignIndexBytes(uint64_t size)
+{
+  return (size + 3) & ~uint64_t(3);
+}
+
+static inline uint64_t alignSection(uint64_t offset)
+{
+  return (offset + 63) & ~uint64_t(63);
+}
+
+template <class T>
+static inline T* getSection(uint8_t* base, const CacheHeader& header, CacheSection section)
+{
+  return (T*)(base + header.sections[section].offset);
+}
+
+template <class T>
+static inline const T* getSection(const uint8_t* base, const CacheHeader& header, CacheSection section)
+{
+  return (const T*)(base + header.sections[section].offset);
+}
+
+
+bool CadScene::hashFile(const char* filename, uint64_t& hash, uint64_t& size)
+{
+  nvh::FileReadMapping file;
+  if(!file.open(filename))
+  {
+    return false;
+  }
+
+  const uint8_t* data = (const uint8_t*)file.data();
+  size                = file.size();
+
+  // FNV-1a over 64-bit words, only used to detect a changed source file
+  const uint64_t prime = 0x100000001b3ull;
+  uint64_t       h     = 0xcbf29ce484222325ull;
+
+  size_t numWords = size_t(size / sizeof(uint64_t));
+  for(size_t i = 0; i < numWords; i++)
+  {
+    uint64_t word;
+    memcpy(&word, data + i * sizeof(uint64_t), sizeof(uint64_t));
+    h = (h ^ word) * prime;
+  }
+  for(size_t i = numWords * sizeof(uint64_t); i < size; i++)
+  {
+    h = (h ^ data[i]) * prime;
+  }
+
+  hash = h ^ size;
+  return true;
+}
+
+// byte range [offset, offset + size) lies within total
+static inline bool isRangeValid(uint64_t offset, uint64_t size, uint64_t total)
+{
+  return offset <= total && size <= total - offset;
+}
+
+// index range of count indices at byte offset lies within the geometry's index data
+static inline bool isIndexRangeValid(uint64_t offset, int64_t count, uint64_t indexSize, uint64_t iboSize)
+{
+  return count >= 0 && offset % indexSize == 0 && isRangeValid(offset, uint64_t(count) * indexSize, iboSize);
+}
+
+static inline uint64_t getIndexBytes(const CacheGeometry& geometry)
+{
+  return uint64_t(geometry.indexSize) * (uint64_t(geometry.numIndexSolid) + uint64_t(geometry.numIndexWire));
+}
+
+static bool isDrawRangeCacheValid(const CacheDrawRangeCache& cache,
+                                  uint32_t                   begin,
+                                  uint32_t                   numParts,
+                                  const CacheGeometry&       geometry,
+                                  const uint8_t*             base,
+                                  const CacheHeader&         header)
+{
+  // caches are rebuilt in place by CadScene::setPartActive, so they must stay within the object's slots
+  if(cache.begin != begin || cache.numStates > numParts || cache.numRanges > numParts)
+  {
+    return false;
+  }
+
+  typedef CadScene::DrawStateInfo DrawStateInfo;
+  const DrawStateInfo*            states      = getSection<DrawStateInfo>(base, header, SECTION_DRAW_STATES) + begin;
+  const int32_t*                  stateCounts = getSection<int32_t>(base, header, SECTION_DRAW_STATE_COUNTS) + begin;
+  const uint64_t*                 offsets     = getSection<uint64_t>(base, header, SECTION_DRAW_OFFSETS) + begin;
+  const int32_t*                  counts      = getSection<int32_t>(base, header, SECTION_DRAW_COUNTS) + begin;
+
+  uint64_t iboSize   = getIndexBytes(geometry);
+  uint64_t numRanges = 0;
+  for(uint32_t s = 0; s < cache.numStates; s++)
+  {
+    if(states[s].materialIndex < 0 || uint64_t(states[s].materialIndex) >= header.sections[SECTION_MATERIALS].count
+       || states[s].matrixIndex < 0 || uint64_t(states[s].matrixIndex) >= header.sections[SECTION_MATRICES].count
+       || stateCounts[s] < 0)
+    {
+      return false;
+    }
+    numRanges += uint64_t(stateCounts[s]);
+  }
+  if(numRanges != cache.numRanges)
+  {
+    return false;
+  }
+
+  for(uint32_t r = 0; r < cache.numRanges; r++)
+  {
+    if(!isIndexRangeValid(offsets[r], counts[r], geometry.indexSize, iboSize))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// checks every span and index the loader or the renderers dereference against its section,
+// so a truncated or modified cache is rejected rather than read out of bounds
+static bool isCacheContentValid(const uint8_t* base, const CacheHeader& header)
+{
+  const CacheSectionInfo* sections    = header.sections;
+  uint64_t                numMatrices = sections[SECTION_MATRICES].count;
+  uint64_t                numVertices = sections[SECTION_VERTICES].count / header.vertexSize;
+
+  if(sections[SECTION_ANIMATION_NODES].count != numMatrices || header.numDequantizationMatrices > numMatrices
+     || sections[SECTION_GEOMETRY_BBOXES].count != sections[SECTION_GEOMETRIES].count
+     || sections[SECTION_DRAW_STATES].count != sections[SECTION_OBJECT_PARTS].count * 2
+     || sections[SECTION_DRAW_STATE_COUNTS].count != sections[SECTION_OBJECT_PARTS].count * 2
+     || sections[SECTION_DRAW_OFFSETS].count != sections[SECTION_OBJECT_PARTS].count * 2
+     || sections[SECTION_DRAW_COUNTS].count != sections[SECTION_OBJECT_PARTS].count * 2)
+  {
+    return false;
+  }
+
+  // dequantization matrices share the animation node of their source
+  const CadScene::AnimationNode* animNodes = getSection<CadScene::AnimationNode>(base, header, SECTION_ANIMATION_NODES);
+  for(uint64_t i = 0; i < numMatrices; i++)
+  {
+    if(animNodes[i].index >= numMatrices - header.numDequantizationMatrices)
+    {
+      return false;
+    }
+  }
+
+  const CacheGeometry*     geometries = getSection<CacheGeometry>(base, header, SECTION_GEOMETRIES);
+  const CacheGeometryPart* geomParts  = getSection<CacheGeometryPart>(base, header, SECTION_GEOMETRY_PARTS);
+
+  for(uint64_t i = 0; i < sections[SECTION_GEOMETRIES].count; i++)
+  {
+    const CacheGeometry& geometry = geometries[i];
+    if(geometry.numVertices < 0 || geometry.numIndexSolid < 0 || geometry.numIndexWire < 0 || geometry.numParts < 0
+       || (geometry.indexSize != sizeof(uint16_t) && geometry.indexSize != sizeof(uint32_t)))
+    {
+      return false;
+    }
+
+    uint64_t iboSize = getIndexBytes(geometry);
+    if(!isRangeValid(geometry.firstVertex, uint64_t(geometry.numVertices), numVertices)
+       || geometry.indexByteOffset % sizeof(uint32_t) != 0
+       || !isRangeValid(geometry.indexByteOffset, iboSize, sections[SECTION_INDICES].count)
+       || !isRangeValid(geometry.firstPart, uint64_t(geometry.numParts), sections[SECTION_GEOMETRY_PARTS].count))
+    {
+      return false;
+    }
+
+    for(int32_t p = 0; p < geometry.numParts; p++)
+    {
+      const CacheGeometryPart& part = geomParts[geometry.firstPart + p];
+      if(!isIndexRangeValid(part.solidOffset, part.solidCount, geometry.indexSize, iboSize)
+         || !isIndexRangeValid(part.wireOffset, part.wireCount, geometry.indexSize, iboSize))
+      {
+        return false;
+      }
+    }
+  }
+
+  const CadScene::ObjectPart* objectParts = getSection<CadScene::ObjectPart>(base, header, SECTION_OBJECT_PARTS);
+  for(uint64_t i = 0; i < sections[SECTION_OBJECT_PARTS].count; i++)
+  {
+    const CadScene::ObjectPart& part = objectParts[i];
+    if(part.materialIndex < 0 || uint64_t(part.materialIndex) >= sections[SECTION_MATERIALS].count
+       || part.matrixIndex < 0 || uint64_t(part.matrixIndex) >= numMatrices)
+    {
+      return false;
+    }
+  }
+
+  const CacheObject* objects = getSection<CacheObject>(base, header, SECTION_OBJECTS);
+  for(uint64_t i = 0; i < sections[SECTION_OBJECTS].count; i++)
+  {
+    const CacheObject& object = objects[i];
+    if(object.matrixIndex < 0 || uint64_t(object.matrixIndex) >= numMatrices || object.geometryIndex < 0
+       || uint64_t(object.geometryIndex) >= sections[SECTION_GEOMETRIES].count)
+    {
+      return false;
+    }
+
+    // object parts match the geometry's parts
+    const CacheGeometry& geometry = geometries[object.geometryIndex];
+    if(object.numParts != uint32_t(geometry.numParts)
+       || !isRangeValid(object.firstPart, object.numParts, sections[SECTION_OBJECT_PARTS].count))
+    {
+      return false;
+    }
+
+    uint32_t slots = object.firstPart * 2;
+    if(!isDrawRangeCacheValid(object.cacheSolid, slots, object.numParts, geometry, base, header)
+       || !isDrawRangeCacheValid(object.cacheWire, slots + object.numParts, object.numParts, geometry, base, header))
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static void storeDrawRangeCache(CacheDrawRangeCache& cached, const CadScene::DrawRangeCache& cache)
+{
+  cached.begin     = cache.begin;
+  cached.numStates = cache.numStates;
+  cached.numRanges = cache.numRanges;
+}
+
+static void loadDrawRangeCache(CadScene::DrawRangeCache& cache, const CacheDrawRangeCache& cached)
+{
+  cache.begin     = cached.begin;
+  cache.numStates = cached.numStates;
+  cache.numRanges = cached.numRanges;
+}
+
+bool CadScene::saveCache(const char* filename, uint64_t sourceHash, uint64_t sourceSize, const LoadConfig& config) const
+{
+  CacheHeader header;
+  memset((void*)&header, 0, sizeof(header));
+  memcpy(header.magic, CADSCENE_CACHE_MAGIC, sizeof(header.magic));
+  header.version                   = CADSCENE_CACHE_VERSION;
+  header.vertexSize                = uint32_t(getVertexSize());
+  header.sourceHash                = sourceHash;
+  header.sourceSize                = sourceSize;
+  header.rootIndex                 = m_rootIndex;
+  header.contentFlags              = getContentFlags(config);
+  header.numDequantizationMatrices = m_loadStats.numDequantizationMatrices;
+  header.acmrBefore                = m_loadStats.acmrBefore;
+  header.acmrAfter                 = m_loadStats.acmrAfter;
+  header.numDuplicateGeometries    = m_loadStats.numDuplicateGeometries;
+  header.duplicateGeometryBytes    = m_loadStats.duplicateGeometryBytes;
+  header.numNonAffineMatrices      = m_loadStats.numNonAffineMatrices;
+  header.bbox                      = m_bbox;
+
+  header.sections[SECTION_MATERIALS].count       = m_materials.size();
+  header.sections[SECTION_MATRICES].count        = m_matrices.size();
+  header.sections[SECTION_ANIMATION_NODES].count = m_animationNodes.size();
+  header.sections[SECTION_GEOMETRY_BBOXES].count = m_geometryBboxes.size();
+  header.sections[SECTION_GEOMETRIES].count      = m_geometry.size();
+  header.sections[SECTION_OBJECTS].count         = m_objects.size();
+
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    const Geometry& geom = m_geometry[i];
+    header.sections[SECTION_GEOMETRY_PARTS].count += geom.numParts;
+    header.sections[SECTION_VERTICES].count += geom.vboSize;
+    header.sections[SECTION_INDICES].count += alignIndexBytes(geom.iboSize);
+  }
+  header.sections[SECTION_OBJECT_PARTS].count      = m_objectParts.size();
+  header.sections[SECTION_DRAW_STATES].count       = m_drawStates.size();
+  header.sections[SECTION_DRAW_STATE_COUNTS].count = m_drawStateCounts.size();
+  header.sections[SECTION_DRAW_OFFSETS].count      = m_drawOffsets.size();
+  header.sections[SECTION_DRAW_COUNTS].count       = m_drawCounts.size();
+
+  uint64_t offset = alignSection(sizeof(CacheHeader));
+  for(int s = 0; s < NUM_SECTIONS; s++)
+  {
+    header.sections[s].offset = offset;
+    offset                    = alignSection(offset + header.sections[s].count * s_sectionElementSize[s]);
+  }
+  header.fileSize = offset;
+
+  // write to a temporary file first, so an interrupted run never leaves a valid looking cache behind
+  std::string tempFilename = std::string(filename) + ".tmp";
+
+  nvh::FileReadOverWriteMapping file;
+  if(!file.open(tempFilename.c_str(), size_t(header.fileSize)))
+  {
+    LOGW("could not write scene cache %s\n", filename);
+    return false;
+  }
+
+  uint8_t* base = (uint8_t*)file.data();
+  memcpy(base, &header, sizeof(header));
+
+  memcpy(getSection<Material>(base, header, SECTION_MATERIALS), m_materials.data(), sizeof(Material) * m_materials.size());
+  memcpy(getSection<MatrixNode>(base, header, SECTION_MATRICES), m_matrices.data(), sizeof(MatrixNode) * m_matrices.size());
+  memcpy(getSection<AnimationNode>(base, header, SECTION_ANIMATION_NODES), m_animationNodes.data(),
+         sizeof(AnimationNode) * m_animationNodes.size());
+  memcpy(getSection<BBox>(base, header, SECTION_GEOMETRY_BBOXES), m_geometryBboxes.data(), sizeof(BBox) * m_geometryBboxes.size());
+
+  CacheGeometry*     geometries = getSection<CacheGeometry>(base, header, SECTION_GEOMETRIES);
+  CacheGeometryPart* geomParts  = getSection<CacheGeometryPart>(base, header, SECTION_GEOMETRY_PARTS);
+  uint8_t*           vertices   = getSection<uint8_t>(base, header, SECTION_VERTICES);
+  uint8_t*           indices    = getSection<uint8_t>(base, header, SECTION_INDICES);
+
+  uint64_t numParts     = 0;
+  uint64_t numVertices  = 0;
+  uint64_t indicesBytes = 0;
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    const Geometry& geom   = m_geometry[i];
+    CacheGeometry&  cached = geometries[i];
+
+    cached.firstVertex     = numVertices;
+    cached.indexByteOffset = indicesBytes;
+    cached.firstPart       = numParts;
+    cached.numVertices     = geom.numVertices;
+    cached.numIndexSolid   = geom.numIndexSolid;
+    cached.numIndexWire    = geom.numIndexWire;
+    cached.numParts        = geom.numParts;
+    cached.indexSize       = geom.indexSize;
+
+    memcpy(vertices + numVertices * getVertexSize(), geom.vboData, geom.vboSize);
+    memcpy(indices + indicesBytes, geom.iboData, geom.iboSize);
+
+    for(int p = 0; p < geom.numParts; p++)
+    {
+      CacheGeometryPart& part = geomParts[numParts + p];
+      part.solidOffset        = geom.parts[p].indexSolid.offset;
+      part.solidCount         = geom.parts[p].indexSolid.count;
+      part.wireOffset         = geom.parts[p].indexWire.offset;
+      part.wireCount          = geom.parts[p].indexWire.count;
+    }
+
+    numVertices += geom.numVertices;
+    indicesBytes += alignIndexBytes(geom.iboSize);
+    numParts += geom.numParts;
+  }
+
+  CacheObject*   objects     = getSection<CacheObject>(base, header, SECTION_OBJECTS);
+  ObjectPart*    objectParts = getSection<ObjectPart>(base, header, SECTION_OBJECT_PARTS);
+  DrawStateInfo* states      = getSection<DrawStateInfo>(base, header, SECTION_DRAW_STATES);
+  int32_t*       stateCounts = getSection<int32_t>(base, header, SECTION_DRAW_STATE_COUNTS);
+  uint64_t*      offsets     = getSection<uint64_t>(base, header, SECTION_DRAW_OFFSETS);
+  int32_t*       counts      = getSection<int32_t>(base, header, SECTION_DRAW_COUNTS);
+
+  for(size_t i = 0; i < m_objects.size(); i++)
+  {
+    const Object& object = m_objects[i];
+    CacheObject&  cached = objects[i];
+
+    cached.matrixIndex   = object.matrixIndex;
+    cached.geometryIndex = object.geometryIndex;
+    cached.firstPart     = object.firstPart;
+    cached.numParts      = object.numParts;
+
+    storeDrawRangeCache(cached.cacheSolid, object.cacheSolid);
+    storeDrawRangeCache(cached.cacheWire, object.cacheWire);
+  }
+
+  memcpy(objectParts, m_objectParts.data(), sizeof(ObjectPart) * m_objectParts.size());
+  memcpy(states, m_drawStates.data(), sizeof(DrawStateInfo) * m_drawStates.size());
+  memcpy(stateCounts, m_drawStateCounts.data(), sizeof(int32_t) * m_drawStateCounts.size());
+  memcpy(counts, m_drawCounts.data(), sizeof(int32_t) * m_drawCounts.size());
+  for(size_t i = 0; i < m_drawOffsets.size(); i++)
+  {
+    offsets[i] = m_drawOffsets[i];
+  }
+
+  file.close();
+
+  std::remove(filename);
+  if(std::rename(tempFilename.c_str(), filename) != 0)
+  {
+    std::remove(tempFilename.c_str());
+    LOGW("could not write scene cache %s\n", filename);
+    return false;
+  }
+
+  return true;
+}
+
+bool CadScene::loadCache(const char* filename, uint64_t sourceHash, uint64_t sourceSize, const LoadConfig& config)
+{
+  nvh::FileReadMapping& file = m_cacheMapping;
+  if(!file.open(filename))
+  {
+    return false;
+  }
+
+  const uint8_t*     base   = (const uint8_t*)file.data();
+  const CacheHeader& header = *(const CacheHeader*)base;
+
+  bool valid = file.size() >= sizeof(CacheHeader) && memcmp(header.magic, CADSCENE_CACHE_MAGIC, sizeof(header.magic)) == 0
+               && header.version == CADSCENE_CACHE_VERSION && header.vertexSize == getVertexSize()
+               && header.sourceHash == sourceHash && header.sourceSize == sourceSize && header.fileSize == file.size()
+               && header.contentFlags == getContentFlags(config);
+
+  for(int s = 0; s < NUM_SECTIONS && valid; s++)
+  {
+    const CacheSectionInfo& section = header.sections[s];
+    valid = section.offset >= sizeof(CacheHeader) && section.offset <= header.fileSize
+            && section.count <= (header.fileSize - section.offset) / s_sectionElementSize[s];
+  }
+
+  valid = valid && isCacheContentValid(base, header);
+
+  if(!valid)
+  {
+    file.close();
+    return false;
+  }
+
+  m_rootIndex                           = header.rootIndex;
+  m_bbox                                = header.bbox;
+  m_loadStats.numDequantizationMatrices = header.numDequantizationMatrices;
+  m_loadStats.acmrBefore                = header.acmrBefore;
+  m_loadStats.acmrAfter                 = header.acmrAfter;
+  m_loadStats.numDuplicateGeometries    = header.numDuplicateGeometries;
+  m_loadStats.duplicateGeometryBytes    = header.duplicateGeometryBytes;
+  m_loadStats.numNonAffineMatrices      = header.numNonAffineMatrices;
+
+  const Material*      materials = getSection<Material>(base, header, SECTION_MATERIALS);
+  const MatrixNode*    matrices  = getSection<MatrixNode>(base, header, SECTION_MATRICES);
+  const AnimationNode* animNodes = getSection<AnimationNode>(base, header, SECTION_ANIMATION_NODES);
+  const BBox*          bboxes    = getSection<BBox>(base, header, SECTION_GEOMETRY_BBOXES);
+
+  m_materials.assign(materials, materials + header.sections[SECTION_MATERIALS].count);
+  m_matrices.assign(matrices, matrices + header.sections[SECTION_MATRICES].count);
+  m_animationNodes.assign(animNodes, animNodes + header.sections[SECTION_ANIMATION_NODES].count);
+  m_numNodes = uint32_t(m_matrices.size() - header.numDequantizationMatrices);
+  m_geometryBboxes.assign(bboxes, bboxes + header.sections[SECTION_GEOMETRY_BBOXES].count);
+
+  const CacheGeometry*     geometries = getSection<CacheGeometry>(base, header, SECTION_GEOMETRIES);
+  const CacheGeometryPart* geomParts  = getSection<CacheGeometryPart>(base, header, SECTION_GEOMETRY_PARTS);
+  const uint8_t*           vertices   = getSection<uint8_t>(base, header, SECTION_VERTICES);
+  const uint8_t*           indices    = getSection<uint8_t>(base, header, SECTION_INDICES);
+
+  m_geometry.resize(header.sections[SECTION_GEOMETRIES].count);
+  for(size_t i = 0; i < m_geometry.size(); i++)
+  {
+    const CacheGeometry& cached = geometries[i];
+    Geometry&            geom   = m_geometry[i];
+
+    geom.cloneIdx      = -1;
+    geom.numVertices   = cached.numVertices;
+    geom.numIndexSolid = cached.numIndexSolid;
+    geom.numIndexWire  = cached.numIndexWire;
+
+    // zero-copy, the mapping is read-only and kept alive until unload
+    geom.vboData   = const_cast<uint8_t*>(vertices + cached.firstVertex * getVertexSize());
+    geom.vboSize   = getVertexSize() * cached.numVertices;
+    geom.vboOwned  = false;
+    geom.iboData   = const_cast<uint8_t*>(indices + cached.indexByteOffset);
+    geom.iboSize   = size_t(cached.indexSize) * (cached.numIndexSolid + cached.numIndexWire);
+    geom.iboOwned  = false;
+    geom.indexSize = cached.indexSize;
+
+    geom.numParts = cached.numParts;
+    geom.parts    = m_arena.allocArray<GeometryPart>(cached.numParts);
+    for(int p = 0; p < cached.numParts; p++)
+    {
+      const CacheGeometryPart& part   = geomParts[cached.firstPart + p];
+      geom.parts[p].indexSolid.offset = size_t(part.solidOffset);
+      geom.parts[p].indexSolid.count  = part.solidCount;
+      geom.parts[p].indexWire.offset  = size_t(part.wireOffset);
+      geom.parts[p].indexWire.count   = part.wireCount;
+    }
+  }
+
+  const CacheObject*   objects     = getSection<CacheObject>(base, header, SECTION_OBJECTS);
+  const ObjectPart*    objectParts = getSection<ObjectPart>(base, header, SECTION_OBJECT_PARTS);
+  const DrawStateInfo* states      = getSection<DrawStateInfo>(base, header, SECTION_DRAW_STATES);
+  const int32_t*       stateCounts = getSection<int32_t>(base, header, SECTION_DRAW_STATE_COUNTS);
+  const uint64_t*      offsets     = getSection<uint64_t>(base, header, SECTION_DRAW_OFFSETS);
+  const int32_t*       counts      = getSection<int32_t>(base, header, SECTION_DRAW_COUNTS);
+
+  m_objects.resize(header.sections[SECTION_OBJECTS].count);
+  for(size_t i = 0; i < m_objects.size(); i++)
+  {
+    const CacheObject& cached = objects[i];
+    Object&            object = m_objects[i];
+
+    object.matrixIndex   = cached.matrixIndex;
+    object.geometryIndex = cached.geometryIndex;
+    object.firstPart     = cached.firstPart;
+    object.numParts      = cached.numParts;
+
+    loadDrawRangeCache(object.cacheSolid, cached.cacheSolid);
+    loadDrawRangeCache(object.cacheWire, cached.cacheWire);
+  }
+
+  m_objectParts.assign(objectParts, objectParts + header.sections[SECTION_OBJECT_PARTS].count);
+  m_drawStates.assign(states, states + header.sections[SECTION_DRAW_STATES].count);
+  m_drawStateCounts.assign(stateCounts, stateCounts + header.sections[SECTION_DRAW_STATE_COUNTS].count);
+  m_drawOffsets.assign(offsets, offsets + header.sections[SECTION_DRAW_OFFSETS].count);
+  m_drawCounts.assign(counts, counts + header.sections[SECTION_DRAW_COUNTS].count);
+
+  return true;
+}
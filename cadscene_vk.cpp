@@ -98,6 +98,8 @@ void CadSceneVK::init(const CadScene& cadscene, nvvk::ResourceAllocator& resourc
 
   m_resourceAllocator = &resourceAllocator;
   m_config            = config;
+  m_quantizedVertices = cadscene.m_quantizedVertices;
+  m_vertexSize        = uint32_t(cadscene.getVertexSize());
   m_geometry.resize(cadscene.m_geometry.size(), {0});
 
   if(m_geometry.empty())
@@ -105,13 +107,22 @@ void CadSceneVK::init(const CadScene& cadscene, nvvk::ResourceAllocator& resourc
 
   {
     // allocation phase
-    m_geometryMem.init(&resourceAllocator, sizeof(CadScene::Vertex), config.singleAllocation ? VkDeviceSize(4096) * MB : 256 * MB);
+    m_geometryMem.init(&resourceAllocator, m_vertexSize, config.singleAllocation ? VkDeviceSize(4096) * MB : 256 * MB);
+
+    VkDeviceSize sharedSize = 0;
 
     for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
     {
       const CadScene::Geometry& cadgeom = cadscene.m_geometry[g];
       Geometry&                 geom    = m_geometry[g];
 
+      // clones alias the buffers of their original geometry
+      if(cadgeom.cloneIdx >= 0)
+      {
+        sharedSize += cadgeom.vboSize + cadgeom.iboSize;
+        continue;
+      }
+
       m_geometryMem.alloc(cadgeom.vboSize, cadgeom.iboSize, geom.allocation);
     }
 
@@ -121,15 +132,24 @@ void CadSceneVK::init(const CadScene& cadscene, nvvk::ResourceAllocator& resourc
     LOGI("Size of index data:  %11" PRId64 "\n", uint64_t(m_geometryMem.getIndexSize()));
     LOGI("Size of data:        %11" PRId64 "\n", uint64_t(m_geometryMem.getVertexSize() + m_geometryMem.getIndexSize()));
     LOGI("Chunks:              %11d\n", uint32_t(m_geometryMem.getChunkCount()));
+    LOGI("Saved by clones:     %11" PRId64 "\n", uint64_t(sharedSize));
   }
 
   ScopeStaging staging(resourceAllocator, queue, queueFamilyIndex);
 
   for(size_t g = 0; g < cadscene.m_geometry.size(); g++)
   {
-    const CadScene::Geometry&      cadgeom = cadscene.m_geometry[g];
-    Geometry&                      geom    = m_geometry[g];
-    const GeometryMemoryVK::Chunk& chunk   = m_geometryMem.getChunk(geom.allocation);
+    const CadScene::Geometry& cadgeom = cadscene.m_geometry[g];
+    Geometry&                 geom    = m_geometry[g];
+
+    if(cadgeom.cloneIdx >= 0)
+    {
+      // originals always precede their clones
+      geom = m_geometry[cadgeom.cloneIdx];
+      continue;
+    }
+
+    const GeometryMemoryVK::Chunk& chunk = m_geometryMem.getChunk(geom.allocation);
 
     // upload and assignment phase
     geom.vbo.buffer = chunk.vbo.buffer;
@@ -141,27 +161,54 @@ void CadSceneVK::init(const CadScene& cadscene, nvvk::ResourceAllocator& resourc
     geom.ibo.offset = geom.allocation.iboOffset;
     geom.ibo.range  = cadgeom.iboSize;
     staging.uploadAutoSubmit(geom.ibo, cadgeom.iboData);
+
+    geom.indexSize = cadgeom.indexSize;
+    geom.indexType = cadgeom.indexSize == sizeof(uint16_t) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
   }
 
   VkBufferUsageFlags usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
   usageFlags |= VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
 
   VkDeviceSize materialsSize = cadscene.m_materials.size() * sizeof(CadScene::Material);
-  VkDeviceSize matricesSize  = cadscene.m_matrices.size() * sizeof(CadScene::MatrixNode);
+  VkDeviceSize matricesSize  = cadscene.getNumMatrices() * sizeof(CadScene::MatrixNode);
+  VkDeviceSize nodesSize     = cadscene.getNumMatrices() * sizeof(CadScene::AnimationNode);
 
-  m_buffers.materials    = resourceAllocator.createBuffer(materialsSize, usageFlags);
-  m_buffers.matrices     = resourceAllocator.createBuffer(matricesSize, usageFlags);
-  m_buffers.matricesOrig = resourceAllocator.createBuffer(matricesSize, usageFlags | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_buffers.materials      = resourceAllocator.createBuffer(materialsSize, usageFlags);
+  m_buffers.matrices       = resourceAllocator.createBuffer(matricesSize, usageFlags);
+  m_buffers.matricesOrig   = resourceAllocator.createBuffer(matricesSize, usageFlags | VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_buffers.animationNodes = resourceAllocator.createBuffer(nodesSize, usageFlags);
 
   m_infos.materialsSingle = {m_buffers.materials.buffer, 0, sizeof(CadScene::Material)};
   m_infos.materials       = {m_buffers.materials.buffer, 0, materialsSize};
   m_infos.matricesSingle  = {m_buffers.matrices.buffer, 0, sizeof(CadScene::MatrixNode)};
   m_infos.matrices        = {m_buffers.matrices.buffer, 0, matricesSize};
   m_infos.matricesOrig    = {m_buffers.matricesOrig.buffer, 0, matricesSize};
+  m_infos.animationNodes  = {m_buffers.animationNodes.buffer, 0, nodesSize};
 
   staging.uploadAutoSubmit(m_infos.materials, cadscene.m_materials.data());
-  staging.uploadAutoSubmit(m_infos.matrices, cadscene.m_matrices.data());
-  staging.uploadAutoSubmit(m_infos.matricesOrig, cadscene.m_matrices.data());
+  if(cadscene.getNumCopies() > 1)
+  {
+    // clone instancing, generate the matrices of each copy from the base scene
+    std::vector<CadScene::MatrixNode>    matrices(cadscene.m_matrices.size());
+    std::vector<CadScene::AnimationNode> nodes(cadscene.m_matrices.size());
+    VkDeviceSize                         copySize  = cadscene.m_matrices.size() * sizeof(CadScene::MatrixNode);
+    VkDeviceSize                         nodesCopy = cadscene.m_matrices.size() * sizeof(CadScene::AnimationNode);
+
+    for(uint32_t c = 0; c < cadscene.getNumCopies(); c++)
+    {
+      cadscene.fillCloneMatrices(c, matrices.data());
+      cadscene.fillCloneAnimationNodes(c, nodes.data());
+      staging.uploadAutoSubmit({m_buffers.matrices.buffer, copySize * c, copySize}, matrices.data());
+      staging.uploadAutoSubmit({m_buffers.matricesOrig.buffer, copySize * c, copySize}, matrices.data());
+      staging.uploadAutoSubmit({m_buffers.animationNodes.buffer, nodesCopy * c, nodesCopy}, nodes.data());
+    }
+  }
+  else
+  {
+    staging.uploadAutoSubmit(m_infos.matrices, cadscene.m_matrices.data());
+    staging.uploadAutoSubmit(m_infos.matricesOrig, cadscene.m_matrices.data());
+    staging.uploadAutoSubmit(m_infos.animationNodes, cadscene.m_animationNodes.data());
+  }
 
   staging.uploadAutoSubmit({}, nullptr);
 }
@@ -171,6 +218,7 @@ void CadSceneVK::deinit()
   m_resourceAllocator->destroy(m_buffers.materials);
   m_resourceAllocator->destroy(m_buffers.matrices);
   m_resourceAllocator->destroy(m_buffers.matricesOrig);
+  m_resourceAllocator->destroy(m_buffers.animationNodes);
   m_geometry.clear();
   m_geometryMem.deinit();
 }
@@ -171,18 +171,22 @@ public:
 
     VkDescriptorBufferInfo vbo;
     VkDescriptorBufferInfo ibo;
+
+    VkIndexType indexType;
+    uint32_t    indexSize;
   };
 
   struct Buffers
   {
-    nvvk::Buffer materials    = {};
-    nvvk::Buffer matrices     = {};
-    nvvk::Buffer matricesOrig = {};
+    nvvk::Buffer materials      = {};
+    nvvk::Buffer matrices       = {};
+    nvvk::Buffer matricesOrig   = {};
+    nvvk::Buffer animationNodes = {};
   };
 
   struct Infos
   {
-    VkDescriptorBufferInfo materialsSingle, materials, matricesSingle, matrices, matricesOrig;
+    VkDescriptorBufferInfo materialsSingle, materials, matricesSingle, matrices, matricesOrig, animationNodes;
   };
 
   struct Config
@@ -197,6 +201,10 @@ public:
   Buffers m_buffers;
   Infos   m_infos;
 
+  // CadScene::Vertex or CadScene::VertexQuantized
+  bool     m_quantizedVertices = false;
+  uint32_t m_vertexSize        = sizeof(CadScene::Vertex);
+
   std::vector<Geometry>    m_geometry;
   GeometryMemoryVK         m_geometryMem;
   nvvk::ResourceAllocator* m_resourceAllocator = nullptr;
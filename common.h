@@ -43,6 +43,7 @@
 #define ANIM_UBO              0
 #define ANIM_SSBO_MATRIXOUT   1
 #define ANIM_SSBO_MATRIXORIG  2
+#define ANIM_SSBO_MATRIXNODE  3
 
 #define ANIMATION_WORKGROUPSIZE   256
 
@@ -112,10 +113,17 @@ struct MaterialData {
   MaterialSide sides[2];
 };
 
+// must match cadscene
+struct AnimationNode {
+  vec3  position;
+  uint  index;
+};
+
 struct AnimationData {
   uint    numMatrices;
   float   time;
-  vec2   _pad0;
+  uint    numNodes;
+  float   _pad0;
 
   vec3    sceneCenter;
   float   sceneDimension;
@@ -35,6 +35,9 @@
 
 #include "renderer.hpp"
 #include "threadpool.hpp"
+#include "octnormals.hpp"
+#include "affinematrix.hpp"
+#include "vertexcache.hpp"
 #include "resources_vk.hpp"
 #include "glm/gtc/matrix_access.hpp"
 
@@ -104,27 +107,35 @@ class Sample : public nvvk::AppWindowProfilerVK
 public:
   struct Tweak
   {
-    int         renderer      = 0;
-    BindingMode binding       = BINDINGMODE_INDEX_VERTEXATTRIB;
-    Strategy    strategy      = STRATEGY_GROUPS;
-    int         msaa          = 4;
-    int         copies        = 4;
-    bool        unordered     = true;
-    bool        interleaved   = true;
-    bool        sorted        = false;
-    bool        permutated    = false;
-    bool        binned        = false;
-    bool        animation     = false;
-    bool        animationSpin = false;
-    int         useShaderObjs = 0;
-    uint32_t    maxShaders    = 16;
-    int         cloneaxisX    = 1;
-    int         cloneaxisY    = 1;
-    int         cloneaxisZ    = 1;
-    float       percent       = 1.01f;
-    uint32_t    workingSet    = 4096;
-    uint32_t    workerThreads = 4;
-    bool        workerBatched = true;
+    int         renderer        = 0;
+    BindingMode binding         = BINDINGMODE_INDEX_VERTEXATTRIB;
+    Strategy    strategy        = STRATEGY_GROUPS;
+    int         msaa            = 4;
+    int         copies          = 4;
+    bool        unordered       = true;
+    bool        interleaved     = true;
+    bool        sorted          = false;
+    bool        permutated      = false;
+    bool        binned          = false;
+    bool        animation       = false;
+    bool        animationSpin   = false;
+    int         useShaderObjs   = 0;
+    uint32_t    maxShaders      = 16;
+    int         cloneaxisX      = 1;
+    int         cloneaxisY      = 1;
+    int         cloneaxisZ      = 1;
+    float       percent         = 1.01f;
+    uint32_t    workingSet      = 4096;
+    uint32_t    workerThreads   = 4;
+    bool        workerBatched   = true;
+    bool        workerSpin      = true;
+    bool        cloneInstancing = false;
+    bool        partUpdates     = false;
+    int         hiddenMaterial  = -1;
+    bool        costSorted      = false;
+    bool        instanced       = false;
+
+    Renderer::StateCosts stateCosts;
   };
 
 
@@ -133,6 +144,12 @@ public:
   bool     m_supportsBinning    = false;
   bool     m_supportsNV         = false;
   uint32_t m_maxThreads         = 1;
+  uint32_t m_benchmarkNormals   = 0;
+  uint32_t m_benchmarkMatrices  = 0;
+  bool     m_benchmarkSort      = false;
+  uint32_t m_fillThreads        = 0;
+  uint32_t m_permutationSeed    = 634523;
+  uint32_t m_threadPlacement    = ThreadPool::PLACEMENT_PHYSICAL_CORES;
 
   ImGuiH::Registry m_ui;
   double           m_uiTime = 0;
@@ -141,7 +158,18 @@ public:
   Tweak m_lastTweak;
   bool  m_lastVsync;
 
+  struct HiddenPart
+  {
+    uint32_t object;
+    uint32_t part;
+  };
+
+  // parts hidden by Tweak::hiddenMaterial
+  std::vector<HiddenPart> m_hiddenParts;
+  int                     m_hiddenMaterialApplied = -1;
+
   CadScene                  m_scene;
+  CadScene::LoadConfig      m_sceneConfig;
   std::vector<unsigned int> m_renderersSorted;
   std::string               m_rendererName;
 
@@ -167,6 +195,8 @@ public:
   void initRenderer(int type);
   void deinitRenderer();
   void initResources();
+  void updateHiddenParts();
+  void printSchedulerStats(const char* what);
 
   void setupConfigParameters();
   void setRendererFromName();
@@ -258,23 +288,63 @@ bool Sample::initScene(const char* filename, int clones, int cloneaxis)
   }
 
   m_scene.unload();
+  m_hiddenParts.clear();
+  m_hiddenMaterialApplied = -1;
 
-  bool status = m_scene.loadCSF(modelFilename.c_str(), clones, cloneaxis);
+  m_sceneConfig.cloneInstancing = m_tweak.cloneInstancing;
+
+  bool status = m_scene.loadCSF(modelFilename.c_str(), m_sceneConfig, clones, cloneaxis);
   if(status)
   {
+    // draw items pack their state into 64 bits, even with a single shader group
+    uint32_t stateBits = Renderer::DrawItemBits::create(&m_scene, 1).getTotal();
+    if(stateBits > 64)
+    {
+      LOGE("\nscene needs %d draw item state bits, more than 64, use fewer copies\n", stateBits);
+      m_scene.unload();
+      return false;
+    }
+
     LOGI("\nscene %s\n", filename);
     LOGI("geometries: %6d\n", uint32_t(m_scene.m_geometry.size()));
     LOGI("materials:  %6d\n", uint32_t(m_scene.m_materials.size()));
-    LOGI("nodes:      %6d\n", uint32_t(m_scene.m_matrices.size()));
-    LOGI("objects:    %6d\n", uint32_t(m_scene.m_objects.size()));
+    LOGI("nodes:      %6d\n", uint32_t(m_scene.getNumMatrices()));
+    LOGI("objects:    %6d\n", uint32_t(m_scene.getNumObjects()));
+    LOGI("instanced:  %6d\n", m_scene.m_cloneInstancing ? 1 : 0);
+    LOGI("quantized:  %6d (%d extra matrices)\n", m_scene.m_quantizedVertices ? 1 : 0,
+         m_scene.m_loadStats.numDequantizationMatrices);
+    LOGI("\n");
+    const char* cacheStates[] = {"disabled", "miss", "written", "loaded"};
+    LOGI("load threads:  %6d\n", m_scene.m_loadStats.numThreads);
+    LOGI("load cache:    %9.2f ms (%s)\n", m_scene.m_loadStats.timeCache, cacheStates[m_scene.m_loadStats.cacheState]);
+    LOGI("load file:     %9.2f ms\n", m_scene.m_loadStats.timeFile);
+    LOGI("load zerocopy: %9zu KB indices\n", m_scene.m_loadStats.sharedIndexBytes / 1024);
+    LOGI("load 16-bit:   %9zu KB indices saved (%d geometries)\n", m_scene.m_loadStats.shortIndexSavedBytes / 1024,
+         m_scene.m_loadStats.numShortIndexGeometries);
+    LOGI("load material: %9.2f ms\n", m_scene.m_loadStats.timeMaterials);
+    LOGI("load geometry: %9.2f ms\n", m_scene.m_loadStats.timeGeometry);
+    LOGI("load dedup:    %9.2f ms (%d geometries, %zu KB merged)\n", m_scene.m_loadStats.timeDeduplicate,
+         m_scene.m_loadStats.numDuplicateGeometries, m_scene.m_loadStats.duplicateGeometryBytes / 1024);
+    LOGI("load ACMR:     %9.3f -> %.3f (%d entry cache)\n", m_scene.m_loadStats.acmrBefore, m_scene.m_loadStats.acmrAfter,
+         VERTEXCACHE_SIZE);
+    LOGI("load nodes:    %9.2f ms (%d non-affine matrices)\n", m_scene.m_loadStats.timeNodes,
+         m_scene.m_loadStats.numNonAffineMatrices);
+    LOGI("load objects:  %9.2f ms\n", m_scene.m_loadStats.timeObjects);
+    LOGI("load clones:   %9.2f ms\n", m_scene.m_loadStats.timeClones);
+    LOGI("load arena:    %9zu KB in %d blocks (%zu allocations, %zu KB huge pages)\n",
+         m_scene.m_loadStats.arena.usedBytes / 1024, m_scene.m_loadStats.arena.numBlocks,
+         m_scene.m_loadStats.arena.numAllocations, m_scene.m_loadStats.arena.hugePageBytes / 1024);
+    LOGI("load total:    %9.2f ms\n", m_scene.m_loadStats.timeTotal);
     LOGI("\n");
+    printSchedulerStats("load");
   }
   else
   {
     LOGW("\ncould not load model %s\n", modelFilename.c_str());
   }
 
-  m_shared.animUbo.numMatrices = uint(m_scene.m_matrices.size());
+  m_shared.animUbo.numMatrices = uint(m_scene.getNumMatrices());
+  m_shared.animUbo.numNodes    = uint(m_scene.getNumNodes());
 
   return status;
 }
@@ -296,6 +366,7 @@ void Sample::initResources()
   CadScene::IndexingBits bits = m_scene.getIndexingBits();
   prepend += nvh::ShaderFileManager::format("#define INDEXED_MATRIX_BITS %d\n", bits.matrices);
   prepend += nvh::ShaderFileManager::format("#define INDEXED_MATERIAL_BITS %d\n", bits.materials);
+  prepend += nvh::ShaderFileManager::format("#define VERTEX_QUANTIZED %d\n", m_scene.m_quantizedVertices ? 1 : 0);
 
   bool valid = m_resources.init(&m_context, &m_swapChain, &m_profiler);
   valid = valid && m_resources.initFramebuffer(m_windowState.m_swapSize[0], m_windowState.m_swapSize[1], m_tweak.msaa, getVsync());
@@ -373,20 +444,33 @@ void Sample::initRenderer(int typesort)
   m_tweak.maxShaders = std::min(m_tweak.maxShaders, std::min(uint32_t(NUM_MATERIAL_SHADERS),
                                                              Renderer::getRegistry()[type]->supportedShaderBinds()));
   m_tweak.maxShaders = std::max(m_tweak.maxShaders, uint32_t(1));
+  // initScene made sure a single shader group fits
+  while(m_tweak.maxShaders > 1 && Renderer::DrawItemBits::create(&m_scene, m_tweak.maxShaders).getTotal() > 64)
+  {
+    m_tweak.maxShaders /= 2;
+    LOGW("max shadergroups reduced to %d, the draw item state must fit into 64 bits\n", m_tweak.maxShaders);
+  }
 
   Renderer::Config config;
-  config.objectFrom    = 0;
-  config.objectNum     = uint32_t(double(m_scene.m_objects.size()) * double(m_tweak.percent));
-  config.strategy      = m_tweak.strategy;
-  config.bindingMode   = m_tweak.binding;
-  config.sorted        = m_tweak.sorted;
-  config.binned        = m_tweak.binned;
-  config.interleaved   = m_tweak.interleaved;
-  config.unordered     = m_tweak.unordered;
-  config.permutated    = m_tweak.permutated;
-  config.maxShaders    = m_tweak.maxShaders;
-  config.workerThreads = m_tweak.workerThreads;
-  config.shaderObjs    = m_tweak.useShaderObjs != 0;
+  config.objectFrom      = 0;
+  config.objectNum       = uint32_t(double(m_scene.getNumObjects()) * double(m_tweak.percent));
+  config.strategy        = m_tweak.strategy;
+  config.bindingMode     = m_tweak.binding;
+  config.sorted          = m_tweak.sorted;
+  config.binned          = m_tweak.binned;
+  config.interleaved     = m_tweak.interleaved;
+  config.unordered       = m_tweak.unordered;
+  config.permutated      = m_tweak.permutated;
+  config.maxShaders      = m_tweak.maxShaders;
+  config.workerThreads   = m_tweak.workerThreads;
+  config.workerSpin      = m_tweak.workerSpin;
+  config.shaderObjs      = m_tweak.useShaderObjs != 0;
+  config.partUpdates     = m_tweak.partUpdates;
+  config.fillThreads     = m_fillThreads;
+  config.permutationSeed = m_permutationSeed;
+  config.costSorted      = m_tweak.costSorted;
+  config.stateCosts      = m_tweak.stateCosts;
+  config.instanced       = m_tweak.instanced && Renderer::getRegistry()[type]->supportsInstancing();
 
   m_renderStats = Renderer::Stats();
 
@@ -397,7 +481,76 @@ void Sample::initRenderer(int typesort)
   LOGI("drawCalls:    %9d\n", m_renderStats.drawCalls);
   LOGI("drawTris:     %9d\n", m_renderStats.drawTriangles);
   LOGI("shaderBinds:  %9d\n", m_renderStats.shaderBindings);
+  LOGI("bufferBinds:  %9d\n", m_renderStats.bufferBindings);
+  LOGI("pushConsts:   %9d\n", m_renderStats.pushConstants);
+  LOGI("descOffsets:  %9d\n", m_renderStats.descriptorOffsets);
+  LOGI("stateCost:    %9.0f\n", m_renderStats.stateCost);
   LOGI("prep.Buffer:  %9d KB\n\n", m_renderStats.preprocessSizeKB);
+  printSchedulerStats("renderer init");
+}
+
+void Sample::printSchedulerStats(const char* what)
+{
+  TaskScheduler&                          scheduler = TaskScheduler::getGlobal();
+  std::vector<TaskScheduler::WorkerStats> stats;
+  scheduler.getStats(stats);
+
+  LOGI("%s workers:\n", what);
+  for(size_t i = 0; i < stats.size(); i++)
+  {
+    double timeTotal = stats[i].timeBusy + stats[i].timeIdle;
+    LOGI("  worker %2zu: %6zu tasks (%6zu stolen), busy %9.2f ms, idle %9.2f ms (%5.1f%%)\n", i, size_t(stats[i].tasks),
+         size_t(stats[i].steals), stats[i].timeBusy, stats[i].timeIdle,
+         timeTotal > 0 ? stats[i].timeIdle * 100.0 / timeTotal : 0.0);
+  }
+  LOGI("\n");
+  scheduler.resetStats();
+}
+
+void Sample::updateHiddenParts()
+{
+  // show the previously hidden parts again, then hide all active parts of the new material
+  std::vector<uint32_t> objects;
+  for(const HiddenPart& hidden : m_hiddenParts)
+  {
+    m_scene.setPartActive(hidden.object, hidden.part, true);
+    objects.push_back(hidden.object);
+  }
+  m_hiddenParts.clear();
+
+  if(m_tweak.hiddenMaterial >= 0)
+  {
+    for(uint32_t o = 0; o < uint32_t(m_scene.m_objects.size()); o++)
+    {
+      const CadScene::Object&     object = m_scene.m_objects[o];
+      const CadScene::ObjectPart* parts  = m_scene.getObjectParts(object);
+      for(uint32_t p = 0; p < object.numParts; p++)
+      {
+        if(parts[p].materialIndex == m_tweak.hiddenMaterial && m_scene.setPartActive(o, p, false))
+        {
+          m_hiddenParts.push_back({o, p});
+          objects.push_back(o);
+        }
+      }
+    }
+  }
+  m_hiddenMaterialApplied = m_tweak.hiddenMaterial;
+
+  std::sort(objects.begin(), objects.end());
+  objects.erase(std::unique(objects.begin(), objects.end()), objects.end());
+
+  if(objects.empty() || !m_renderer)
+    return;
+
+  m_resources.synchronize();
+  if(m_renderer->updateParts(objects, m_renderStats))
+  {
+    LOGI("parts: %d objects patched\n", uint32_t(objects.size()));
+  }
+  else
+  {
+    initRenderer(m_tweak.renderer);
+  }
 }
 
 
@@ -406,6 +559,7 @@ void Sample::end()
   deinitRenderer();
   m_resources.deinit();
   ResourcesVK::deinitImGui(m_context);
+  TaskScheduler::getGlobal().deinit();
 }
 
 
@@ -444,6 +598,16 @@ bool Sample::begin()
   m_supportsNV         = m_context.hasDeviceExtension(VK_NV_DEVICE_GENERATED_COMMANDS_EXTENSION_NAME);
   m_supportsShaderObjs = m_context.hasDeviceExtension(VK_EXT_SHADER_OBJECT_EXTENSION_NAME);
 
+  {
+    const ThreadPool::Topology& topology = ThreadPool::sysGetTopology();
+    LOGI("cpu topology: %d logical, %d cores, %d L3 domains, %d numa nodes, placement %d\n",
+         int(topology.cpus.size()), topology.numCores, topology.numL3, topology.numNuma, m_threadPlacement);
+  }
+  ThreadPool::sysSetPlacement(ThreadPool::Placement(std::min(m_threadPlacement, uint32_t(ThreadPool::PLACEMENT_L3_DOMAINS))));
+
+  // the calling thread participates in parallel work
+  TaskScheduler::getGlobal().init(m_maxThreads - 1);
+
   bool validated(true);
   validated = validated && initProgram();
   validated = validated
@@ -456,6 +620,21 @@ bool Sample::begin()
     return false;
   }
 
+  if(m_benchmarkNormals)
+  {
+    octNormalsBenchmark(m_benchmarkNormals);
+  }
+
+  if(m_benchmarkMatrices)
+  {
+    affineMatrixBenchmark(m_benchmarkMatrices);
+  }
+
+  if(m_benchmarkSort)
+  {
+    Renderer::sortBenchmark(&m_scene);
+  }
+
   ResourcesVK::initImGui(m_context);
 
   const Renderer::Registry registry = Renderer::getRegistry();
@@ -516,7 +695,8 @@ bool Sample::begin()
 
   m_shared.animUbo.sceneCenter    = m_control.m_sceneOrbit;
   m_shared.animUbo.sceneDimension = m_control.m_sceneDimension * 0.2f;
-  m_shared.animUbo.numMatrices    = uint(m_scene.m_matrices.size());
+  m_shared.animUbo.numMatrices    = uint(m_scene.getNumMatrices());
+  m_shared.animUbo.numNodes       = uint(m_scene.getNumNodes());
   m_shared.sceneUbo.wLightPos     = (m_scene.m_bbox.max + m_scene.m_bbox.min) * 0.5f + m_control.m_sceneDimension;
   m_shared.sceneUbo.wLightPos.w   = 1.0;
 
@@ -551,10 +731,18 @@ void Sample::processUI(int width, int height, double time)
 
     //guiRegistry.enumCombobox(GUI_SUPERSAMPLE, "supersample", &tweak.supersample);
     ImGuiH::InputIntClamped("max shadergroups", &m_tweak.maxShaders, 1, NUM_MATERIAL_SHADERS, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
-    ImGuiH::InputIntClamped("copies", &m_tweak.copies, 1, 16, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGuiH::InputIntClamped("copies", &m_tweak.copies, 1, 64, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::Checkbox("copies: instanced", &m_tweak.cloneInstancing);
     ImGui::SliderFloat("pct visible", &m_tweak.percent, 0.0f, 1.001f);
     ImGui::Checkbox("sorted once (minimized state changes)", &m_tweak.sorted);
+    ImGui::Checkbox("sorted: by state cost", &m_tweak.costSorted);
+    ImGui::InputFloat("cost: shader bind", &m_tweak.stateCosts.shaderBind, 0, 0, "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::InputFloat("cost: buffer bind", &m_tweak.stateCosts.bufferBind, 0, 0, "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::InputFloat("cost: push constant", &m_tweak.stateCosts.pushConstant, 0, 0, "%.2f", ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::InputFloat("cost: descriptor offset", &m_tweak.stateCosts.descriptorOffset, 0, 0, "%.2f",
+                      ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::Checkbox("permutated (random state changes,\ngen nv: use seqindex)", &m_tweak.permutated);
+    ImGui::Checkbox("draws: hw instancing (vertexattrib)", &m_tweak.instanced);
     ImGui::Checkbox("gen: unordered (non-coherent)", &m_tweak.unordered);
     if(m_supportsBinning)
     {
@@ -570,6 +758,10 @@ void Sample::processUI(int width, int height, double time)
     ImGuiH::InputIntClamped("threaded: drawcalls per cmdbuffer", &m_tweak.workingSet, 512, 1 << 20, 512, 1024,
                             ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::Checkbox("threaded: batched submission", &m_tweak.workerBatched);
+    ImGui::Checkbox("threaded: spin before park", &m_tweak.workerSpin);
+    ImGui::Checkbox("part updates: reserve draw slots", &m_tweak.partUpdates);
+    ImGuiH::InputIntClamped("part updates: hidden material", &m_tweak.hiddenMaterial, -1,
+                            std::max(int(m_scene.m_materials.size()) - 1, -1), 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::Checkbox("animation", &m_tweak.animation);
     ImGui::PopItemWidth();
     ImGui::Separator();
@@ -631,9 +823,31 @@ void Sample::processUI(int width, int height, double time)
       ImGui::Text(" drawCalls:            %9d\n", m_renderStats.drawCalls);
       ImGui::Text(" drawTris:             %9d\n", m_renderStats.drawTriangles);
       ImGui::Text(" serial shaderBinds:   %9d\n", m_renderStats.shaderBindings);
+      ImGui::Text(" serial bufferBinds:   %9d\n", m_renderStats.bufferBindings);
+      ImGui::Text(" serial pushConstants: %9d\n", m_renderStats.pushConstants);
+      ImGui::Text(" serial descOffsets:   %9d\n", m_renderStats.descriptorOffsets);
+      ImGui::Text(" serial stateCost:     %9.0f\n", m_renderStats.stateCost);
       ImGui::Text(" dgc sequences:        %9d\n", m_renderStats.sequences);
       ImGui::Text(" dgc preprocessBuffer: %9d KB\n", m_renderStats.preprocessSizeKB);
       ImGui::Text(" dgc indirectBuffer:   %9d KB\n\n", m_renderStats.indirectSizeKB);
+      if(m_renderStats.wakeLatency.getCount())
+      {
+        ImGui::Text(" wake latency p50/p99:    %6.2f / %6.2f us\n", m_renderStats.wakeLatency.getPercentile(0.5),
+                    m_renderStats.wakeLatency.getPercentile(0.99));
+        ImGui::Text(" handoff latency p50/p99: %6.2f / %6.2f us\n", m_renderStats.handoffLatency.getPercentile(0.5),
+                    m_renderStats.handoffLatency.getPercentile(0.99));
+        auto plotLatency = [](const char* label, const Renderer::LatencyHistogram& histogram) {
+          float buckets[Renderer::LatencyHistogram::NUM_BUCKETS];
+          for(uint32_t i = 0; i < Renderer::LatencyHistogram::NUM_BUCKETS; i++)
+          {
+            buckets[i] = float(histogram.buckets[i]);
+          }
+          ImGui::PlotHistogram(label, buckets, Renderer::LatencyHistogram::NUM_BUCKETS, 0, "0.25 us .. 8 ms, log2",
+                               0.0f, FLT_MAX, ImVec2(0, 40));
+        };
+        plotLatency("wake", m_renderStats.wakeLatency);
+        plotLatency("handoff", m_renderStats.handoffLatency);
+      }
     }
   }
   ImGui::End();
@@ -661,25 +875,37 @@ void Sample::think(double time)
 
   bool sceneChanged = false;
   if(m_tweak.copies != m_lastTweak.copies || m_tweak.cloneaxisX != m_lastTweak.cloneaxisX
-     || m_tweak.cloneaxisY != m_lastTweak.cloneaxisY || m_tweak.cloneaxisZ != m_lastTweak.cloneaxisZ)
+     || m_tweak.cloneaxisY != m_lastTweak.cloneaxisY || m_tweak.cloneaxisZ != m_lastTweak.cloneaxisZ
+     || m_tweak.cloneInstancing != m_lastTweak.cloneInstancing)
   {
     sceneChanged = true;
     m_resources.synchronize();
     deinitRenderer();
     m_resources.deinitScene();
-    initScene(m_modelFilename.c_str(), m_tweak.copies - 1,
-              (m_tweak.cloneaxisX << 0) | (m_tweak.cloneaxisY << 1) | (m_tweak.cloneaxisZ << 2));
+    if(!initScene(m_modelFilename.c_str(), m_tweak.copies - 1,
+                  (m_tweak.cloneaxisX << 0) | (m_tweak.cloneaxisY << 1) | (m_tweak.cloneaxisZ << 2)))
+    {
+      // e.g. too many copies for the draw item state, go back to the last scene
+      m_tweak.copies          = m_lastTweak.copies;
+      m_tweak.cloneaxisX      = m_lastTweak.cloneaxisX;
+      m_tweak.cloneaxisY      = m_lastTweak.cloneaxisY;
+      m_tweak.cloneaxisZ      = m_lastTweak.cloneaxisZ;
+      m_tweak.cloneInstancing = m_lastTweak.cloneInstancing;
+      initScene(m_modelFilename.c_str(), m_tweak.copies - 1,
+                (m_tweak.cloneaxisX << 0) | (m_tweak.cloneaxisY << 1) | (m_tweak.cloneaxisZ << 2));
+    }
     m_resources.initScene(m_scene);
   }
 
   bool rendererChanged = false;
-  if(m_windowState.onPress(KEY_R) || m_tweak.copies != m_lastTweak.copies)
+  if(m_windowState.onPress(KEY_R) || sceneChanged)
   {
     m_resources.synchronize();
     std::string            prepend;
     CadScene::IndexingBits bits = m_scene.getIndexingBits();
     prepend += nvh::ShaderFileManager::format("#define INDEXED_MATRIX_BITS %d\n", bits.matrices);
     prepend += nvh::ShaderFileManager::format("#define INDEXED_MATERIAL_BITS %d\n", bits.materials);
+    prepend += nvh::ShaderFileManager::format("#define VERTEX_QUANTIZED %d\n", m_scene.m_quantizedVertices ? 1 : 0);
     m_resources.reloadPrograms(prepend);
     rendererChanged = true;
   }
@@ -690,12 +916,23 @@ void Sample::think(double time)
      || m_tweak.workerThreads != m_lastTweak.workerThreads || m_tweak.workerBatched != m_lastTweak.workerBatched
      || m_tweak.maxShaders != m_lastTweak.maxShaders || m_tweak.interleaved != m_lastTweak.interleaved
      || m_tweak.permutated != m_lastTweak.permutated || m_tweak.unordered != m_lastTweak.unordered
-     || m_tweak.binned != m_lastTweak.binned || m_tweak.useShaderObjs != m_lastTweak.useShaderObjs)
+     || m_tweak.binned != m_lastTweak.binned || m_tweak.useShaderObjs != m_lastTweak.useShaderObjs
+     || m_tweak.partUpdates != m_lastTweak.partUpdates || m_tweak.costSorted != m_lastTweak.costSorted
+     || m_tweak.instanced != m_lastTweak.instanced || m_tweak.workerSpin != m_lastTweak.workerSpin
+     || m_tweak.stateCosts.shaderBind != m_lastTweak.stateCosts.shaderBind
+     || m_tweak.stateCosts.bufferBind != m_lastTweak.stateCosts.bufferBind
+     || m_tweak.stateCosts.pushConstant != m_lastTweak.stateCosts.pushConstant
+     || m_tweak.stateCosts.descriptorOffset != m_lastTweak.stateCosts.descriptorOffset)
   {
     m_resources.synchronize();
     initRenderer(m_tweak.renderer);
   }
 
+  if(m_tweak.hiddenMaterial != m_hiddenMaterialApplied)
+  {
+    updateHiddenParts();
+  }
+
   m_resources.beginFrame();
 
   if(m_tweak.animation != m_lastTweak.animation)
@@ -821,13 +1058,39 @@ void Sample::setupConfigParameters()
   m_parameterList.add("shadermode", (uint32_t*)&m_tweak.useShaderObjs);
   m_parameterList.add("msaa", &m_tweak.msaa);
   m_parameterList.add("copies", &m_tweak.copies);
+  m_parameterList.add("cloneinstancing", &m_tweak.cloneInstancing);
   m_parameterList.add("animation", &m_tweak.animation);
   m_parameterList.add("animationspin", &m_tweak.animationSpin);
   m_parameterList.add("minstatechanges", &m_tweak.sorted);
   m_parameterList.add("maxshaders", &m_tweak.maxShaders);
   m_parameterList.add("workerbatched", &m_tweak.workerBatched);
   m_parameterList.add("workerthreads", &m_tweak.workerThreads);
+  m_parameterList.add("workerspin", &m_tweak.workerSpin);
   m_parameterList.add("workingset", &m_tweak.workingSet);
+  m_parameterList.add("partupdates", &m_tweak.partUpdates);
+  m_parameterList.add("costsorted", &m_tweak.costSorted);
+  m_parameterList.add("instanced", &m_tweak.instanced);
+  m_parameterList.add("costshaderbind", &m_tweak.stateCosts.shaderBind);
+  m_parameterList.add("costbufferbind", &m_tweak.stateCosts.bufferBind);
+  m_parameterList.add("costpushconstant", &m_tweak.stateCosts.pushConstant);
+  m_parameterList.add("costdescriptoroffset", &m_tweak.stateCosts.descriptorOffset);
+  m_parameterList.add("fillthreads", &m_fillThreads);
+  m_parameterList.add("permutationseed", &m_permutationSeed);
+  m_parameterList.add("threadplacement", &m_threadPlacement);
+  m_parameterList.add("hiddenmaterial", &m_tweak.hiddenMaterial);
+  m_parameterList.add("loadthreads", &m_sceneConfig.numThreads);
+  m_parameterList.add("loadsimdnormals", &m_sceneConfig.simdNormals);
+  m_parameterList.add("loadsimdmatrices", &m_sceneConfig.simdMatrices);
+  m_parameterList.add("scenecache", &m_sceneConfig.useCache);
+  m_parameterList.add("zerocopyindices", &m_sceneConfig.zeroCopyIndices);
+  m_parameterList.add("shortindices", &m_sceneConfig.shortIndices);
+  m_parameterList.add("quantizedvertices", &m_sceneConfig.quantizedVertices);
+  m_parameterList.add("optimizevertexcache", &m_sceneConfig.optimizeVertexCache);
+  m_parameterList.add("deduplicategeometry", &m_sceneConfig.deduplicateGeometry);
+  m_parameterList.add("hugepages", &m_sceneConfig.hugePages);
+  m_parameterList.add("benchmarknormals", &m_benchmarkNormals);
+  m_parameterList.add("benchmarkmatrices", &m_benchmarkMatrices);
+  m_parameterList.add("benchmarksort", &m_benchmarkSort);
   m_parameterList.add("animation", &m_tweak.animation);
   m_parameterList.add("animationspin", &m_tweak.animationSpin);
 }
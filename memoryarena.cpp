@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "memoryarena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+// transparent huge pages are 2 MB on x86-64 and most aarch64 kernels
+static const size_t s_hugePageSize = size_t(2) * 1024 * 1024;
+
+static inline size_t alignSize(size_t size, size_t alignment)
+{
+  return (size + alignment - 1) & ~(alignment - 1);
+}
+
+void MemoryArena::init(size_t blockSize, bool hugePages)
+{
+  reset();
+  m_blockSize = blockSize;
+  m_hugePages = hugePages;
+}
+
+MemoryArena::Block MemoryArena::allocBlock(size_t size)
+{
+  Block block;
+  block.size = alignSize(size, s_hugePageSize);
+
+#if defined(__linux__)
+  void* base = mmap(nullptr, block.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  block.base = base == MAP_FAILED ? nullptr : (uint8_t*)base;
+#ifdef MADV_HUGEPAGE
+  // only a hint, the kernel may still use regular pages
+  if(block.base && m_hugePages && madvise(block.base, block.size, MADV_HUGEPAGE) == 0)
+  {
+    m_stats.hugePageBytes += block.size;
+  }
+#endif
+#elif defined(_WIN32)
+  // large pages need SeLockMemoryPrivilege, regular pages are used
+  block.base = (uint8_t*)VirtualAlloc(nullptr, block.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  block.base = (uint8_t*)malloc(block.size);
+#endif
+
+  if(!block.base)
+  {
+    throw std::bad_alloc();
+  }
+
+  m_stats.numBlocks++;
+  m_stats.reservedBytes += block.size;
+  return block;
+}
+
+void MemoryArena::freeBlock(const Block& block)
+{
+#if defined(__linux__)
+  munmap(block.base, block.size);
+#elif defined(_WIN32)
+  VirtualFree(block.base, 0, MEM_RELEASE);
+#else
+  free(block.base);
+#endif
+}
+
+void* MemoryArena::alloc(size_t size, size_t alignment)
+{
+  assert(alignment && (alignment & (alignment - 1)) == 0);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  size_t offset = alignSize(m_blockUsed, alignment);
+  if(m_blocks.empty() || offset + size > m_blocks.back().size)
+  {
+    // a larger allocation gets a dedicated block, which is put in front of the current one
+    // so the remaining space of the current block stays in use
+    Block block = allocBlock(std::max(size, m_blockSize));
+    if(!m_blocks.empty() && size > m_blockSize)
+    {
+      m_blocks.insert(m_blocks.end() - 1, block);
+      m_stats.numAllocations++;
+      m_stats.usedBytes += size;
+      return block.base;
+    }
+
+    m_blocks.push_back(block);
+    offset = 0;
+  }
+
+  m_blockUsed = offset + size;
+  m_stats.numAllocations++;
+  m_stats.usedBytes += size;
+  return m_blocks.back().base + offset;
+}
+
+void MemoryArena::reset()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for(const Block& block : m_blocks)
+  {
+    freeBlock(block);
+  }
+  m_blocks.clear();
+  m_blockUsed = 0;
+  m_stats     = Stats();
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef MEMORYARENA_H__
+#define MEMORYARENA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Bump allocator for data that lives as long as the scene. Memory comes from a few
+// large blocks that are only released all at once by reset(). On Linux the blocks
+// are mapped directly and can be backed by transparent huge pages.
+class MemoryArena
+{
+public:
+  struct Stats
+  {
+    uint32_t numBlocks      = 0;
+    size_t   numAllocations = 0;
+    // sum of all requested sizes
+    size_t usedBytes = 0;
+    // size of all blocks
+    size_t reservedBytes = 0;
+    // part of reservedBytes advised to use huge pages
+    size_t hugePageBytes = 0;
+  };
+
+  MemoryArena() = default;
+  MemoryArena(const MemoryArena&) = delete;
+  MemoryArena& operator=(const MemoryArena&) = delete;
+  ~MemoryArena() { reset(); }
+
+  // blockSize is the minimum size of newly mapped blocks, larger allocations get a block of their own
+  void init(size_t blockSize, bool hugePages);
+
+  // thread-safe
+  void* alloc(size_t size, size_t alignment = 16);
+
+  template <class T>
+  T* allocArray(size_t count)
+  {
+    return (T*)alloc(sizeof(T) * count, alignof(T) > 16 ? alignof(T) : 16);
+  }
+
+  // releases all blocks, previously returned memory becomes invalid
+  void reset();
+
+  Stats getStats() const { return m_stats; }
+
+private:
+  struct Block
+  {
+    uint8_t* base;
+    size_t   size;
+  };
+
+  Block allocBlock(size_t size);
+  void  freeBlock(const Block& block);
+
+  size_t m_blockSize = size_t(64) * 1024 * 1024;
+  bool   m_hugePages = false;
+
+  std::mutex         m_mutex;
+  std::vector<Block> m_blocks;
+  size_t             m_blockUsed = 0;
+  Stats              m_stats;
+};
+
+#endif
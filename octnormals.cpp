@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "octnormals.hpp"
+#include "octnormals_kernel.hpp"
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCTNORMALS_SSE 1
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define OCTNORMALS_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Every path must round each multiply and add separately, otherwise fused
+// multiply-adds make the SIMD results drift from the scalar reference.
+// CMakeLists.txt builds this file with -ffp-contract=off (/fp:precise on MSVC).
+
+
+// all oct functions derived from "A Survey of Efficient Representations for Independent Unit Vectors"
+// http://jcgt.org/published/0003/02/01/paper.pdf
+// Returns +/- 1
+inline glm::vec3 oct_signNotZero(glm::vec3 v)
+{
+  // leaves z as is
+  return glm::vec3((v.x >= 0.0f) ? +1.0f : -1.0f, (v.y >= 0.0f) ? +1.0f : -1.0f, 1.0f);
+}
+
+// Assume normalized input. Output is on [-1, 1] for each component.
+inline glm::vec3 float32x3_to_oct(glm::vec3 v)
+{
+  // Project the sphere onto the octahedron, and then onto the xy plane
+  glm::vec3 p = glm::vec3(v.x, v.y, 0) * (1.0f / (fabsf(v.x) + fabsf(v.y) + fabsf(v.z)));
+  // Reflect the folds of the lower hemisphere over the diagonals
+  return (v.z <= 0.0f) ? glm::vec3(1.0f - fabsf(p.y), 1.0f - fabsf(p.x), 0.0f) * oct_signNotZero(p) : p;
+}
+
+inline glm::vec3 oct_to_float32x3(glm::vec3 e)
+{
+  glm::vec3 v = glm::vec3(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+  if(v.z < 0.0f)
+  {
+    v = glm::vec3(1.0f - fabs(v.y), 1.0f - fabs(v.x), v.z) * oct_signNotZero(v);
+  }
+  return glm::normalize(v);
+}
+
+inline glm::vec3 float32x3_to_octn_precise(glm::vec3 v, const int n)
+{
+  glm::vec3 s = float32x3_to_oct(v);  // Remap to the square
+                                      // Each snorm's max value interpreted as an integer,
+                                      // e.g., 127.0 for snorm8
+  float M = float(1 << ((n / 2) - 1)) - 1.0;
+  // Remap components to snorm(n/2) precision...with floor instead
+  // of round (see equation 1)
+  s                            = glm::floor(glm::clamp(s, -1.0f, +1.0f) * M) * (1.0f / M);
+  glm::vec3 bestRepresentation = s;
+  float     highestCosine      = glm::dot(oct_to_float32x3(s), v);
+  // Test all combinations of floor and ceil and keep the best.
+  // Note that at +/- 1, this will exit the square... but that
+  // will be a worse encoding and never win.
+  for(int i = 0; i <= 1; ++i)
+  {
+    for(int j = 0; j <= 1; ++j)
+    {
+      // This branch will be evaluated at compile time
+      if((i != 0) || (j != 0))
+      {
+        // Offset the bit pattern (which is stored in floating
+        // point!) to effectively change the rounding mode
+        // (when i or j is 0: floor, when it is one: ceiling)
+        glm::vec3 candidate = glm::vec3(i, j, 0) * (1 / M) + s;
+        float     cosine    = glm::dot(oct_to_float32x3(candidate), v);
+        if(cosine > highestCosine)
+        {
+          bestRepresentation = candidate;
+          highestCosine      = cosine;
+        }
+      }
+    }
+  }
+  return bestRepresentation;
+}
+
+static void encodeScalar(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride)
+{
+  for(size_t i = 0; i < numNormals; i++)
+  {
+    const float* in  = normals + i * normalStride;
+    uint16_t*    out = (uint16_t*)((uint8_t*)outXY + i * outStride);
+
+    glm::vec3 packed = float32x3_to_octn_precise(glm::vec3(in[0], in[1], in[2]), 16);
+    out[0]           = clampSnorm16(int32_t(packed.x * 32767.0f));
+    out[1]           = clampSnorm16(int32_t(packed.y * 32767.0f));
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SIMD paths, the shared kernel lives in octnormals_kernel.hpp
+
+#if OCTNORMALS_SSE
+struct OpsSSE
+{
+  typedef __m128 F;
+  typedef __m128 M;
+  enum
+  {
+    W = 4
+  };
+
+  static F load(const float* p) { return _mm_loadu_ps(p); }
+  static F set(float f) { return _mm_set1_ps(f); }
+  static F add(F a, F b) { return _mm_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm_div_ps(a, b); }
+  static F sqrt(F a) { return _mm_sqrt_ps(a); }
+  static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+  static M cmpge(F a, F b) { return _mm_cmpge_ps(a, b); }
+  static M cmpgt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+  static M cmple(F a, F b) { return _mm_cmple_ps(a, b); }
+  static M cmplt(F a, F b) { return _mm_cmplt_ps(a, b); }
+  static F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+  static F floor(F a)
+  {
+    // SSE2 has no floor, truncate and step down for negative fractions.
+    // Keeps -0.0, NaN and values beyond 2^23 as they are, like std::floor.
+    F t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a));
+    t   = _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a), _mm_set1_ps(1.0f)));
+    t   = _mm_or_ps(t, _mm_and_ps(a, _mm_set1_ps(-0.0f)));
+    return select(_mm_cmplt_ps(abs(a), _mm_set1_ps(8388608.0f)), t, a);
+  }
+  static void storeInt(int32_t* p, F a) { _mm_storeu_si128((__m128i*)p, _mm_cvttps_epi32(a)); }
+};
+#endif
+
+
+#if OCTNORMALS_NEON
+struct OpsNEON
+{
+  typedef float32x4_t F;
+  typedef uint32x4_t  M;
+  enum
+  {
+    W = 4
+  };
+
+  static F load(const float* p) { return vld1q_f32(p); }
+  static F set(float f) { return vdupq_n_f32(f); }
+  static F add(F a, F b) { return vaddq_f32(a, b); }
+  static F sub(F a, F b) { return vsubq_f32(a, b); }
+  static F mul(F a, F b) { return vmulq_f32(a, b); }
+  static F div(F a, F b) { return vdivq_f32(a, b); }
+  static F sqrt(F a) { return vsqrtq_f32(a); }
+  static F abs(F a) { return vabsq_f32(a); }
+  static M cmpge(F a, F b) { return vcgeq_f32(a, b); }
+  static M cmpgt(F a, F b) { return vcgtq_f32(a, b); }
+  static M cmple(F a, F b) { return vcleq_f32(a, b); }
+  static M cmplt(F a, F b) { return vcltq_f32(a, b); }
+  static F select(M m, F a, F b) { return vbslq_f32(m, a, b); }
+  static F floor(F a) { return vrndmq_f32(a); }
+  static void storeInt(int32_t* p, F a) { vst1q_s32(p, vcvtq_s32_f32(a)); }
+};
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+
+#if OCTNORMALS_SSE
+// octnormals_avx2.cpp is compiled with AVX2 enabled, only call into it when
+// the cpu and the OS (saved ymm state) support it.
+static bool cpuSupportsAVX2()
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < 7)
+    return false;
+
+  __cpuid(info, 1);
+  const int osxsave = 1 << 27;
+  const int avx     = 1 << 28;
+  if((info[2] & (osxsave | avx)) != (osxsave | avx) || (_xgetbv(0) & 6) != 6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__)
+  return __builtin_cpu_supports("avx2") != 0;
+#else
+  return false;
+#endif
+}
+
+static bool hasAVX2()
+{
+  static const bool supported = octNormalsAVX2Compiled() && cpuSupportsAVX2();
+  return supported;
+}
+#endif
+
+OctNormalPath octNormalsGetBestPath()
+{
+#if OCTNORMALS_SSE
+  if(hasAVX2())
+    return OCTNORMAL_AVX2;
+#endif
+#if OCTNORMALS_NEON
+  return OCTNORMAL_NEON;
+#elif OCTNORMALS_SSE
+  return OCTNORMAL_SSE;
+#else
+  return OCTNORMAL_SCALAR;
+#endif
+}
+
+bool octNormalsIsSupported(OctNormalPath path)
+{
+  switch(path)
+  {
+    case OCTNORMAL_SCALAR:
+      return true;
+#if OCTNORMALS_SSE
+    case OCTNORMAL_SSE:
+      return true;
+#endif
+#if OCTNORMALS_SSE
+    case OCTNORMAL_AVX2:
+      return hasAVX2();
+#endif
+#if OCTNORMALS_NEON
+    case OCTNORMAL_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+const char* octNormalsGetPathName(OctNormalPath path)
+{
+  switch(path)
+  {
+    case OCTNORMAL_SCALAR:
+      return "scalar";
+    case OCTNORMAL_SSE:
+      return "sse";
+    case OCTNORMAL_AVX2:
+      return "avx2";
+    case OCTNORMAL_NEON:
+      return "neon";
+    default:
+      return "unknown";
+  }
+}
+
+void octNormalsEncode(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride, OctNormalPath path)
+{
+  if(!numNormals)
+    return;
+
+  switch(path)
+  {
+#if OCTNORMALS_SSE
+    case OCTNORMAL_SSE:
+      OctKernel<OpsSSE>::encodeBatch(normals, normalStride, numNormals, outXY, outStride);
+      break;
+#endif
+#if OCTNORMALS_SSE
+    case OCTNORMAL_AVX2:
+      if(hasAVX2())
+      {
+        octNormalsEncodeAVX2(normals, normalStride, numNormals, outXY, outStride);
+        break;
+      }
+      OctKernel<OpsSSE>::encodeBatch(normals, normalStride, numNormals, outXY, outStride);
+      break;
+#endif
+#if OCTNORMALS_NEON
+    case OCTNORMAL_NEON:
+      OctKernel<OpsNEON>::encodeBatch(normals, normalStride, numNormals, outXY, outStride);
+      break;
+#endif
+    default:
+      encodeScalar(normals, normalStride, numNormals, outXY, outStride);
+      break;
+  }
+}
+
+void octNormalsBenchmark(size_t numNormals)
+{
+  std::vector<float> normals(numNormals * 3);
+
+  std::mt19937                          rng(1234);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for(size_t i = 0; i < numNormals; i++)
+  {
+    glm::vec3 n(dist(rng), dist(rng), dist(rng));
+    // mix in the axis aligned normals typical for CAD data
+    if(i % 16 == 0)
+    {
+      n = glm::vec3(0);
+      n[i % 3] = (i % 32) ? 1.0f : -1.0f;
+    }
+    n = glm::normalize(n);
+
+    normals[i * 3 + 0] = n.x;
+    normals[i * 3 + 1] = n.y;
+    normals[i * 3 + 2] = n.z;
+  }
+
+  std::vector<uint16_t> reference(numNormals * 2);
+  std::vector<uint16_t> result(numNormals * 2);
+
+  LOGI("octnormals benchmark: %zu normals\n", numNormals);
+  for(int p = 0; p < NUM_OCTNORMAL_PATHS; p++)
+  {
+    OctNormalPath path = OctNormalPath(p);
+    if(!octNormalsIsSupported(path))
+      continue;
+
+    std::vector<uint16_t>& output = path == OCTNORMAL_SCALAR ? reference : result;
+
+    auto begin = std::chrono::steady_clock::now();
+    octNormalsEncode(normals.data(), 3, numNormals, output.data(), sizeof(uint16_t) * 2, path);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    size_t mismatches = 0;
+    if(path != OCTNORMAL_SCALAR)
+    {
+      for(size_t i = 0; i < numNormals * 2; i++)
+      {
+        mismatches += reference[i] != result[i] ? 1 : 0;
+      }
+    }
+
+    LOGI("  %-6s: %9.2f Mnormals/s, mismatches %zu\n", octNormalsGetPathName(path),
+         seconds > 0 ? double(numNormals) / seconds / 1000000.0 : 0.0, mismatches);
+  }
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef OCTNORMALS_H__
+#define OCTNORMALS_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Batch encoder for the precise 16-bit octahedral normals stored in CadScene::Vertex.
+// All paths produce bit-identical results to the scalar reference.
+
+enum OctNormalPath
+{
+  OCTNORMAL_SCALAR,
+  OCTNORMAL_SSE,   // 2 x 4 normals per iteration
+  OCTNORMAL_AVX2,  // 2 x 8 normals per iteration, x86 only, picked when the cpu supports AVX2
+  OCTNORMAL_NEON,  // 2 x 4 normals per iteration, aarch64 only
+  NUM_OCTNORMAL_PATHS,
+};
+
+// widest path that was compiled in and the cpu supports
+OctNormalPath octNormalsGetBestPath();
+bool          octNormalsIsSupported(OctNormalPath path);
+const char*   octNormalsGetPathName(OctNormalPath path);
+
+// normals: xyz floats, consecutive normals are normalStride floats apart
+// outXY:   receives the x,y snorm pair per normal, consecutive pairs are outStride bytes apart
+void octNormalsEncode(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride, OctNormalPath path);
+
+// times all supported paths on numNormals random normals, verifies they match the
+// scalar reference and prints normals/sec
+void octNormalsBenchmark(size_t numNormals);
+
+#endif
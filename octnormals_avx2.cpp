@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Built with AVX2 enabled and without FP contraction (see CMakeLists.txt),
+// octnormals.cpp only calls in here after checking the cpu at runtime.
+
+#include "octnormals_kernel.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+namespace {
+struct OpsAVX2
+{
+  typedef __m256 F;
+  typedef __m256 M;
+  enum
+  {
+    W = 8
+  };
+
+  static F load(const float* p) { return _mm256_loadu_ps(p); }
+  static F set(float f) { return _mm256_set1_ps(f); }
+  static F add(F a, F b) { return _mm256_add_ps(a, b); }
+  static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+  static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+  static F div(F a, F b) { return _mm256_div_ps(a, b); }
+  static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+  static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+  static M cmpge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+  static M cmpgt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+  static M cmple(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+  static M cmplt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+  static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+  static F floor(F a) { return _mm256_floor_ps(a); }
+  static void storeInt(int32_t* p, F a) { _mm256_storeu_si256((__m256i*)p, _mm256_cvttps_epi32(a)); }
+};
+}  // namespace
+
+bool octNormalsAVX2Compiled()
+{
+  return true;
+}
+
+void octNormalsEncodeAVX2(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride)
+{
+  OctKernel<OpsAVX2>::encodeBatch(normals, normalStride, numNormals, outXY, outStride);
+}
+
+#else
+
+bool octNormalsAVX2Compiled()
+{
+  return false;
+}
+
+void octNormalsEncodeAVX2(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride) {}
+
+#endif
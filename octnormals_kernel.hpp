@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef OCTNORMALS_KERNEL_H__
+#define OCTNORMALS_KERNEL_H__
+
+#include <cstddef>
+#include <cstdint>
+
+// Internal to octnormals.cpp and octnormals_avx2.cpp. The latter is compiled with
+// AVX2 enabled, so this header avoids std:: templates whose out-of-line copies
+// could be shared with, and then picked for, the baseline translation unit.
+
+static inline uint16_t clampSnorm16(int32_t value)
+{
+  return uint16_t(value < -32767 ? -32767 : (value > 32767 ? 32767 : value));
+}
+
+//////////////////////////////////////////////////////////////////////////
+// SIMD paths
+//
+// The kernel mirrors float32x3_to_octn_precise operation by operation in the
+// same order, so every lane rounds exactly like the scalar code. glm's
+// min/max/clamp are expressed as compare + select to keep their NaN behavior.
+// The Ops class S provides the vector type and its operations.
+
+template <class S>
+struct OctKernel
+{
+  typedef typename S::F F;
+  typedef typename S::M M;
+
+  // oct_signNotZero
+  static F signNotZero(F a) { return S::select(S::cmpge(a, S::set(0.0f)), S::set(1.0f), S::set(-1.0f)); }
+
+  // glm::dot(oct_to_float32x3(e), v)
+  static F cosine(F ex, F ey, F vx, F vy, F vz)
+  {
+    F one = S::set(1.0f);
+    F ax  = S::abs(ex);
+    F ay  = S::abs(ey);
+    F x   = ex;
+    F y   = ey;
+    F z   = S::sub(S::sub(one, ax), ay);
+
+    M fold = S::cmplt(z, S::set(0.0f));
+    x      = S::select(fold, S::mul(S::sub(one, ay), signNotZero(ex)), x);
+    y      = S::select(fold, S::mul(S::sub(one, ax), signNotZero(ey)), y);
+
+    // glm::normalize
+    F len = S::add(S::add(S::mul(x, x), S::mul(y, y)), S::mul(z, z));
+    F inv = S::div(one, S::sqrt(len));
+    x     = S::mul(x, inv);
+    y     = S::mul(y, inv);
+    z     = S::mul(z, inv);
+
+    return S::add(S::add(S::mul(x, vx), S::mul(y, vy)), S::mul(z, vz));
+  }
+
+  // glm::clamp(a, lo, hi)
+  static F clamp(F a, F lo, F hi)
+  {
+    a = S::select(S::cmplt(a, lo), lo, a);
+    return S::select(S::cmplt(hi, a), hi, a);
+  }
+
+  static void encode(const float* inX, const float* inY, const float* inZ, int32_t* outX, int32_t* outY)
+  {
+    F vx = S::load(inX);
+    F vy = S::load(inY);
+    F vz = S::load(inZ);
+
+    F zero = S::set(0.0f);
+    F one  = S::set(1.0f);
+
+    // float32x3_to_oct
+    F r  = S::div(one, S::add(S::add(S::abs(vx), S::abs(vy)), S::abs(vz)));
+    F px = S::mul(vx, r);
+    F py = S::mul(vy, r);
+
+    M lower = S::cmple(vz, zero);
+    F sx    = S::select(lower, S::mul(S::sub(one, S::abs(py)), signNotZero(px)), px);
+    F sy    = S::select(lower, S::mul(S::sub(one, S::abs(px)), signNotZero(py)), py);
+
+    // snorm8 precision with floor, then test the ceil candidates
+    float M_   = float(1 << 7) - 1.0;
+    F     vM   = S::set(M_);
+    F     invM = S::set(1.0f / M_);
+
+    sx = S::mul(S::floor(S::mul(clamp(sx, S::set(-1.0f), one), vM)), invM);
+    sy = S::mul(S::floor(S::mul(clamp(sy, S::set(-1.0f), one), vM)), invM);
+
+    F bestX   = sx;
+    F bestY   = sy;
+    F highest = cosine(sx, sy, vx, vy, vz);
+
+    for(int i = 0; i <= 1; ++i)
+    {
+      for(int j = 0; j <= 1; ++j)
+      {
+        if((i != 0) || (j != 0))
+        {
+          F cx = S::add(S::mul(S::set(float(i)), invM), sx);
+          F cy = S::add(S::mul(S::set(float(j)), invM), sy);
+          F c  = cosine(cx, cy, vx, vy, vz);
+
+          M better = S::cmpgt(c, highest);
+          bestX    = S::select(better, cx, bestX);
+          bestY    = S::select(better, cy, bestY);
+          highest  = S::select(better, c, highest);
+        }
+      }
+    }
+
+    S::storeInt(outX, S::mul(bestX, S::set(32767.0f)));
+    S::storeInt(outY, S::mul(bestY, S::set(32767.0f)));
+  }
+
+  static void encodeBatch(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride)
+  {
+    // two vectors per iteration
+    const size_t BATCH = S::W * 2;
+
+    float   x[BATCH];
+    float   y[BATCH];
+    float   z[BATCH];
+    int32_t ox[BATCH];
+    int32_t oy[BATCH];
+
+    for(size_t b = 0; b < numNormals; b += BATCH)
+    {
+      size_t count = BATCH < numNormals - b ? BATCH : numNormals - b;
+      for(size_t i = 0; i < BATCH; i++)
+      {
+        const float* in = normals + (b + (i < count ? i : count - 1)) * normalStride;
+        x[i]            = in[0];
+        y[i]            = in[1];
+        z[i]            = in[2];
+      }
+
+      encode(x, y, z, ox, oy);
+      encode(x + S::W, y + S::W, z + S::W, ox + S::W, oy + S::W);
+
+      for(size_t i = 0; i < count; i++)
+      {
+        uint16_t* out = (uint16_t*)((uint8_t*)outXY + (b + i) * outStride);
+        out[0]        = clampSnorm16(ox[i]);
+        out[1]        = clampSnorm16(oy[i]);
+      }
+    }
+  }
+};
+
+// implemented in octnormals_avx2.cpp, only valid if octNormalsAVX2Compiled()
+bool octNormalsAVX2Compiled();
+void octNormalsEncodeAVX2(const float* normals, size_t normalStride, size_t numNormals, uint16_t* outXY, size_t outStride);
+
+#endif
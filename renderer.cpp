@@ -20,115 +20,292 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
 #include "renderer.hpp"
+#include "threadpool.hpp"
 #include <nvpwindow.hpp>
 
 #include "common.h"
 
-#pragma pack(1)
-
 
 namespace generatedcmds {
 //////////////////////////////////////////////////////////////////////////
 
-static void AddItem(std::vector<Renderer::DrawItem>& drawItems, const Renderer::Config& config, const Renderer::DrawItem& di)
+// objects per parallel fill batch, and draw items per stats batch
+static const size_t s_fillBatchSize  = 256;
+static const size_t s_statsBatchSize = 64 * 1024;
+// digit size of the draw key radix sort, the histogram stays within L1
+static const uint32_t s_radixBits = 11;
+// Feistel rounds of the random draw permutation
+static const uint32_t s_permutationRounds = 4;
+
+static void AddItem(Renderer::DrawItem*&         drawItems,
+                    const Renderer::DrawItemBits& bits,
+                    const CadScene::Geometry&     geo,
+                    bool                          solid,
+                    int                           shaderIndex,
+                    int                           geometryIndex,
+                    int                           materialIndex,
+                    int                           matrixIndex,
+                    const CadScene::DrawRange&    range)
 {
-  if(di.range.count)
+  if(range.count)
   {
-    drawItems.push_back(di);
+    Renderer::DrawItem& di = *drawItems++;
+    di.state               = bits.pack(solid, shaderIndex, geometryIndex, materialIndex, matrixIndex);
+    di.firstIndex          = uint32_t(range.offset / geo.indexSize);
+    di.count               = uint32_t(range.count);
   }
 }
 
-static void FillSingle(std::vector<Renderer::DrawItem>& drawItems,
-                       const Renderer::Config&          config,
-                       const CadScene::Object&          obj,
-                       const CadScene::Geometry&        geo,
-                       bool                             solid,
-                       int                              objectIndex)
+static void FillSingle(Renderer::DrawItem*&          drawItems,
+                       const Renderer::Config&       config,
+                       const Renderer::DrawItemBits& bits,
+                       const CadScene&               scene,
+                       const CadScene::Object&       obj,
+                       const CadScene::Geometry&     geo,
+                       bool                          solid,
+                       int                           objectIndex,
+                       int                           matrixOffset)
 {
-  int                             begin = 0;
-  const CadScene::DrawRangeCache& cache = solid ? obj.cacheSolid : obj.cacheWire;
-
-  if(obj.parts.empty())
+  if(!obj.numParts)
     return;
 
-  const CadScene::ObjectPart&   part = obj.parts[0];
+  const CadScene::ObjectPart&   part = scene.getObjectParts(obj)[0];
   const CadScene::GeometryPart& mesh = geo.parts[0];
 
   if(!part.active)
     return;
 
   // evict
-  Renderer::DrawItem di;
-  di.geometryIndex = obj.geometryIndex;
-  di.matrixIndex   = part.matrixIndex;
-  di.materialIndex = part.materialIndex;
-  di.shaderIndex   = part.materialIndex % config.maxShaders;
-
-  di.solid        = solid;
-  di.range.offset = solid ? 0 : geo.numIndexSolid * sizeof(unsigned int);
-  di.range.count  = solid ? geo.numIndexSolid : geo.numIndexWire;
+  CadScene::DrawRange range;
+  range.offset = solid ? 0 : geo.numIndexSolid * size_t(geo.indexSize);
+  range.count  = solid ? geo.numIndexSolid : geo.numIndexWire;
 
-  AddItem(drawItems, config, di);
+  AddItem(drawItems, bits, geo, solid, part.materialIndex % config.maxShaders, obj.geometryIndex, part.materialIndex,
+          part.matrixIndex + matrixOffset, range);
 }
 
-static void FillCache(std::vector<Renderer::DrawItem>& drawItems,
-                      const Renderer::Config&          config,
-                      const CadScene::Object&          obj,
-                      const CadScene::Geometry&        geo,
-                      bool                             solid,
-                      int                              objectIndex)
+static void FillCache(Renderer::DrawItem*&          drawItems,
+                      const Renderer::Config&       config,
+                      const Renderer::DrawItemBits& bits,
+                      const CadScene&               scene,
+                      const CadScene::Object&       obj,
+                      const CadScene::Geometry&     geo,
+                      bool                          solid,
+                      int                           objectIndex,
+                      int                           matrixOffset)
 {
-  int                             begin = 0;
-  const CadScene::DrawRangeCache& cache = solid ? obj.cacheSolid : obj.cacheWire;
+  const CadScene::DrawRangeCache& cache       = solid ? obj.cacheSolid : obj.cacheWire;
+  const CadScene::DrawStateInfo*  states      = scene.m_drawStates.data() + cache.begin;
+  const int*                      stateCounts = scene.m_drawStateCounts.data() + cache.begin;
+  const size_t*                   offsets     = scene.m_drawOffsets.data() + cache.begin;
+  const int*                      counts      = scene.m_drawCounts.data() + cache.begin;
 
-  for(size_t s = 0; s < cache.state.size(); s++)
+  int begin = 0;
+  for(uint32_t s = 0; s < cache.numStates; s++)
   {
-    const CadScene::DrawStateInfo& state = cache.state[s];
-    for(int d = 0; d < cache.stateCount[s]; d++)
+    const CadScene::DrawStateInfo& state = states[s];
+    for(int d = 0; d < stateCounts[s]; d++)
     {
       // evict
-      Renderer::DrawItem di;
-      di.geometryIndex = obj.geometryIndex;
-      di.matrixIndex   = state.matrixIndex;
-      di.materialIndex = state.materialIndex;
-      di.shaderIndex   = state.materialIndex % config.maxShaders;
+      CadScene::DrawRange range;
+      range.offset = offsets[begin + d];
+      range.count  = counts[begin + d];
 
-      di.solid        = solid;
-      di.range.offset = cache.offsets[begin + d];
-      di.range.count  = cache.counts[begin + d];
-
-      AddItem(drawItems, config, di);
+      AddItem(drawItems, bits, geo, solid, state.materialIndex % config.maxShaders, obj.geometryIndex,
+              state.materialIndex, state.matrixIndex + matrixOffset, range);
     }
-    begin += cache.stateCount[s];
+    begin += stateCounts[s];
   }
 }
 
-static void FillIndividual(std::vector<Renderer::DrawItem>& drawItems,
-                           const Renderer::Config&          config,
-                           const CadScene::Object&          obj,
-                           const CadScene::Geometry&        geo,
-                           bool                             solid,
-                           int                              objectIndex)
+static void FillIndividual(Renderer::DrawItem*&          drawItems,
+                           const Renderer::Config&       config,
+                           const Renderer::DrawItemBits& bits,
+                           const CadScene&               scene,
+                           const CadScene::Object&       obj,
+                           const CadScene::Geometry&     geo,
+                           bool                          solid,
+                           int                           objectIndex,
+                           int                           matrixOffset)
 {
-  for(size_t p = 0; p < obj.parts.size(); p++)
+  const CadScene::ObjectPart* parts = scene.getObjectParts(obj);
+  for(uint32_t p = 0; p < obj.numParts; p++)
   {
-    const CadScene::ObjectPart&   part = obj.parts[p];
+    const CadScene::ObjectPart&   part = parts[p];
     const CadScene::GeometryPart& mesh = geo.parts[p];
 
     if(!part.active)
       continue;
 
-    Renderer::DrawItem di;
-    di.geometryIndex = obj.geometryIndex;
-    di.matrixIndex   = part.matrixIndex;
-    di.materialIndex = part.materialIndex;
-    di.shaderIndex   = part.materialIndex % config.maxShaders;
+    AddItem(drawItems, bits, geo, solid, part.materialIndex % config.maxShaders, obj.geometryIndex, part.materialIndex,
+            part.matrixIndex + matrixOffset, solid ? mesh.indexSolid : mesh.indexWire);
+  }
+}
+
+// must match the number of non-empty items the Fill functions above generate
+static uint32_t CountObject(const Renderer::Config& config, const CadScene& scene, size_t i, bool solid, bool wire)
+{
+  size_t                    numBaseObjects = scene.m_objects.size();
+  const CadScene::Object&   obj            = scene.m_objects[i % numBaseObjects];
+  const CadScene::Geometry& geo            = scene.m_geometry[obj.geometryIndex];
+
+  uint32_t count = 0;
+  if(config.strategy == STRATEGY_SINGLE)
+  {
+    if(obj.numParts && scene.getObjectParts(obj)[0].active)
+    {
+      count += (solid && geo.numIndexSolid) ? 1 : 0;
+      count += (wire && geo.numIndexWire) ? 1 : 0;
+    }
+  }
+  else if(config.strategy == STRATEGY_GROUPS)
+  {
+    for(int pass = 0; pass < 2; pass++)
+    {
+      if(!(pass == 0 ? solid : wire))
+        continue;
+
+      const CadScene::DrawRangeCache& cache  = pass == 0 ? obj.cacheSolid : obj.cacheWire;
+      const int*                      counts = scene.m_drawCounts.data() + cache.begin;
+      for(uint32_t r = 0; r < cache.numRanges; r++)
+      {
+        count += counts[r] ? 1 : 0;
+      }
+    }
+  }
+  else if(config.strategy == STRATEGY_INDIVIDUAL)
+  {
+    const CadScene::ObjectPart* parts = scene.getObjectParts(obj);
+    for(uint32_t p = 0; p < obj.numParts; p++)
+    {
+      if(!parts[p].active)
+        continue;
+
+      count += (solid && geo.parts[p].indexSolid.count) ? 1 : 0;
+      count += (wire && geo.parts[p].indexWire.count) ? 1 : 0;
+    }
+  }
+
+  return count;
+}
+
+static uint32_t GetObjectDrawSlots(const Renderer::Config& config, const CadScene::Object& obj)
+{
+  // groups never yield more ranges than there are parts
+  return config.strategy == STRATEGY_SINGLE ? std::min(obj.numParts, 1u) : obj.numParts;
+}
+
+// returns the number of items written
+static uint32_t FillObject(Renderer::DrawItem*           drawItems,
+                           const Renderer::Config&       config,
+                           const Renderer::DrawItemBits& bits,
+                           const CadScene&               scene,
+                           size_t                        i,
+                           bool                          solid,
+                           bool                          wire)
+{
+  // with clone instancing objects beyond the base scene are generated from base object and copy
+  size_t                    numBaseObjects = scene.m_objects.size();
+  const CadScene::Object&   obj            = scene.m_objects[i % numBaseObjects];
+  const CadScene::Geometry& geo            = scene.m_geometry[obj.geometryIndex];
+  int                       matrixOffset   = int(i / numBaseObjects) * int(scene.m_matrices.size());
+
+  Renderer::DrawItem* begin = drawItems;
+
+  if(config.strategy == STRATEGY_SINGLE)
+  {
+    if(solid)
+      FillSingle(drawItems, config, bits, scene, obj, geo, true, int(i), matrixOffset);
+    if(wire)
+      FillSingle(drawItems, config, bits, scene, obj, geo, false, int(i), matrixOffset);
+  }
+  else if(config.strategy == STRATEGY_GROUPS)
+  {
+    if(solid)
+      FillCache(drawItems, config, bits, scene, obj, geo, true, int(i), matrixOffset);
+    if(wire)
+      FillCache(drawItems, config, bits, scene, obj, geo, false, int(i), matrixOffset);
+  }
+  else if(config.strategy == STRATEGY_INDIVIDUAL)
+  {
+    if(solid)
+      FillIndividual(drawItems, config, bits, scene, obj, geo, true, int(i), matrixOffset);
+    if(wire)
+      FillIndividual(drawItems, config, bits, scene, obj, geo, false, int(i), matrixOffset);
+  }
+
+  return uint32_t(drawItems - begin);
+}
+
+static void PadObject(Renderer::DrawItem*           drawItems,
+                      const Renderer::Config&       config,
+                      const Renderer::DrawItemBits& bits,
+                      const CadScene&               scene,
+                      size_t                        i,
+                      uint32_t                      numUsed,
+                      uint32_t                      numSlots)
+{
+  assert(numUsed <= numSlots);
+  if(numUsed == numSlots)
+    return;
 
-    di.solid = solid;
-    di.range = solid ? mesh.indexSolid : mesh.indexWire;
+  // empty slots repeat the last state of the object, so they add no state changes
+  Renderer::DrawItem di;
+  if(numUsed)
+  {
+    di = drawItems[numUsed - 1];
+  }
+  else
+  {
+    size_t                      numBaseObjects = scene.m_objects.size();
+    const CadScene::Object&     obj            = scene.m_objects[i % numBaseObjects];
+    const CadScene::ObjectPart& part           = scene.getObjectParts(obj)[0];
 
-    AddItem(drawItems, config, di);
+    di.state = bits.pack(true, part.materialIndex % config.maxShaders, obj.geometryIndex, part.materialIndex,
+                         part.matrixIndex + int(i / numBaseObjects) * int(scene.m_matrices.size()));
+  }
+  di.firstIndex = 0;
+  di.count      = 0;
+
+  std::fill(drawItems + numUsed, drawItems + numSlots, di);
+}
+
+// state changes of the serial recording from prev to di, prev is nullptr for the first draw
+static void AddStateChanges(Renderer::Stats&              stats,
+                            const Renderer::DrawItemBits& bits,
+                            const Renderer::Config&       config,
+                            const Renderer::DrawItem*     prev,
+                            const Renderer::DrawItem&     di)
+{
+  const Renderer::StateCosts& costs = config.stateCosts;
+
+  if(!prev || bits.getShaderIndex(*prev) != bits.getShaderIndex(di))
+  {
+    stats.shaderBindings++;
+    stats.stateCost += costs.shaderBind;
+  }
+  if(!prev || bits.getGeometryIndex(*prev) != bits.getGeometryIndex(di))
+  {
+    stats.bufferBindings++;
+    stats.stateCost += costs.bufferBind;
+  }
+
+  // the indexed modes pass matrix and material through the instance index
+  uint32_t changes = (!prev || bits.getMaterialIndex(*prev) != bits.getMaterialIndex(di) ? 1 : 0)
+                     + (!prev || bits.getMatrixIndex(*prev) != bits.getMatrixIndex(di) ? 1 : 0);
+  if(config.bindingMode == BINDINGMODE_DSETS)
+  {
+    stats.descriptorOffsets += changes;
+    stats.stateCost += costs.descriptorOffset * float(changes);
+  }
+  else if(config.bindingMode == BINDINGMODE_PUSHADDRESS)
+  {
+    stats.pushConstants += changes;
+    stats.stateCost += costs.pushConstant * float(changes);
   }
 }
 
@@ -137,89 +314,752 @@ void Renderer::fillDrawItems(std::vector<DrawItem>& drawItems, const CadScene* s
   bool solid = true;
   bool wire  = false;
 
-  size_t maxObjects = scene->m_objects.size();
-  size_t from       = std::min(maxObjects - 1, size_t(config.objectFrom));
-  maxObjects        = std::min(maxObjects, from + size_t(config.objectNum));
+  size_t numBaseObjects = scene->m_objects.size();
+  size_t maxObjects     = scene->getNumObjects();
+  size_t from           = std::min(maxObjects - 1, size_t(config.objectFrom));
+  maxObjects            = std::min(maxObjects, from + size_t(config.objectNum));
+
+  size_t       numObjects = maxObjects - from;
+  unsigned int numThreads = config.fillThreads ? config.fillThreads : ThreadPool::sysGetNumCores();
+  bool         useSlots   = config.partUpdates && !config.sorted && !config.permutated;
+
+  m_drawItemBits = DrawItemBits::create(scene, config.maxShaders);
+  // Sample::initScene rejects such scenes and initRenderer reduces the shader groups, so this is only
+  // reached by other callers
+  if(m_drawItemBits.getTotal() > 64)
+  {
+    LOGE("draw item state needs %d bits, more than 64, nothing is drawn\n", m_drawItemBits.getTotal());
+    m_objectDrawSlots.clear();
+    return;
+  }
+  const DrawItemBits& bits = m_drawItemBits;
+
+  // Items are generated in object order like a serial walk would do:
+  // count per object, prefix sum into the offsets, then fill all objects in parallel.
+  std::vector<uint32_t> offsets(numObjects + 1, 0);
+
+  ThreadPool::parallelBatches(numObjects, s_fillBatchSize, numThreads, [&](size_t begin, size_t end) {
+    for(size_t o = begin; o < end; o++)
+    {
+      size_t i = from + o;
+      if(useSlots)
+      {
+        offsets[o + 1] = GetObjectDrawSlots(config, scene->m_objects[i % numBaseObjects]) * ((solid ? 1 : 0) + (wire ? 1 : 0));
+      }
+      else
+      {
+        offsets[o + 1] = CountObject(config, *scene, i, solid, wire);
+      }
+    }
+  });
 
-  for(size_t i = from; i < maxObjects; i++)
+  uint32_t first = uint32_t(drawItems.size());
+  offsets[0]     = first;
+  for(size_t o = 0; o < numObjects; o++)
   {
-    const CadScene::Object&   obj = scene->m_objects[i];
-    const CadScene::Geometry& geo = scene->m_geometry[obj.geometryIndex];
+    offsets[o + 1] += offsets[o];
+  }
+
+  drawItems.resize(offsets[numObjects]);
 
-    if(config.strategy == STRATEGY_SINGLE)
+  ThreadPool::parallelBatches(numObjects, s_fillBatchSize, numThreads, [&](size_t begin, size_t end) {
+    for(size_t o = begin; o < end; o++)
     {
-      if(solid)
-        FillSingle(drawItems, config, obj, geo, true, int(i));
-      if(wire)
-        FillSingle(drawItems, config, obj, geo, false, int(i));
+      uint32_t numSlots = offsets[o + 1] - offsets[o];
+      uint32_t numUsed  = FillObject(drawItems.data() + offsets[o], config, bits, *scene, from + o, solid, wire);
+      if(useSlots)
+      {
+        PadObject(drawItems.data() + offsets[o], config, bits, *scene, from + o, numUsed, numSlots);
+      }
+      assert(numUsed <= numSlots && (useSlots || numUsed == numSlots));
     }
-    else if(config.strategy == STRATEGY_GROUPS)
+  });
+
+  if(useSlots)
+  {
+    m_objectDrawSlots = std::move(offsets);
+  }
+  else
+  {
+    m_objectDrawSlots.clear();
+  }
+
+  bool useInstances = config.instanced && config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB && !config.permutated && !useSlots;
+
+  if(config.sorted && !config.permutated)
+  {
+    if(config.costSorted)
     {
-      if(solid)
-        FillCache(drawItems, config, obj, geo, true, int(i));
-      if(wire)
-        FillCache(drawItems, config, obj, geo, false, int(i));
+      sortDrawItemsByCost(drawItems, bits, config.bindingMode, config.stateCosts);
     }
-    else if(config.strategy == STRATEGY_INDIVIDUAL)
+    else
     {
-      if(solid)
-        FillIndividual(drawItems, config, obj, geo, true, int(i));
-      if(wire)
-        FillIndividual(drawItems, config, obj, geo, false, int(i));
+      sortDrawItems(drawItems);
     }
   }
 
-  if(config.sorted && !config.permutated)
+  if(useInstances)
+  {
+    fillDrawInstances(drawItems, bits, m_drawInstances);
+  }
+  else
   {
-    std::sort(drawItems.begin(), drawItems.end(), DrawItem_compare_groups);
+    m_drawInstances.clear();
   }
 
-  int shaderIndex = -1;
-  for(size_t i = 0; i < drawItems.size(); i++)
+  // per-batch partial stats are summed in batch order
+  size_t             numItems   = drawItems.size();
+  size_t             numBatches = (numItems + s_statsBatchSize - 1) / s_statsBatchSize;
+  std::vector<Stats> batchStats(numBatches);
+  const DrawItem*    items = drawItems.data();
+
+  ThreadPool::parallelBatches(numItems, s_statsBatchSize, numThreads, [&](size_t begin, size_t end) {
+    Stats& batch = batchStats[begin / s_statsBatchSize];
+    for(size_t i = begin; i < end; i++)
+    {
+      if(items[i].count)
+      {
+        batch.drawCalls++;
+        batch.drawTriangles += items[i].count / 3;
+      }
+      // the serial walk starts with nothing bound
+      AddStateChanges(batch, bits, config, i ? &items[i - 1] : nullptr, items[i]);
+    }
+  });
+
+  // instances of a draw share shader and geometry, so only the draw calls differ
+  if(useInstances)
   {
-    stats.drawCalls++;
-    stats.drawTriangles += drawItems[i].range.count / 3;
-    if(drawItems[i].shaderIndex != shaderIndex)
+    for(const DrawSlots& draw : m_drawInstances)
     {
-      stats.shaderBindings++;
-      shaderIndex = drawItems[i].shaderIndex;
+      stats.drawCalls += items[draw.begin].count ? 1 : 0;
     }
   }
+
+  for(const Stats& batch : batchStats)
+  {
+    stats.drawCalls += useInstances ? 0 : batch.drawCalls;
+    stats.drawTriangles += batch.drawTriangles;
+    stats.shaderBindings += batch.shaderBindings;
+    stats.bufferBindings += batch.bufferBindings;
+    stats.pushConstants += batch.pushConstants;
+    stats.descriptorOffsets += batch.descriptorOffsets;
+    stats.stateCost += batch.stateCost;
+  }
 }
 
-void Renderer::fillRandomPermutation(uint32_t drawCount, uint32_t* permutation, const DrawItem* drawItems, Stats& stats)
+bool Renderer::updateDrawItems(std::vector<DrawItem>& drawItems, const std::vector<uint32_t>& objects, std::vector<DrawSlots>& slots, Stats& stats)
 {
-  srand(634523);
-  for(uint32_t i = 0; i < drawCount; i++)
+  slots.clear();
+
+  if(m_objectDrawSlots.empty())
+    return false;
+
+  bool solid = true;
+  bool wire  = false;
+
+  size_t numBaseObjects = m_scene->m_objects.size();
+  size_t maxObjects     = m_scene->getNumObjects();
+  size_t from           = std::min(maxObjects - 1, size_t(m_config.objectFrom));
+  maxObjects            = std::min(maxObjects, from + size_t(m_config.objectNum));
+
+  std::vector<DrawItem> objectItems;
+  for(uint32_t objectIndex : objects)
+  {
+    // instanced clones share the parts of their base object
+    for(size_t i = objectIndex; i < maxObjects; i += numBaseObjects)
+    {
+      if(i < from)
+        continue;
+
+      uint32_t begin = m_objectDrawSlots[i - from];
+      uint32_t count = m_objectDrawSlots[i - from + 1] - begin;
+
+      objectItems.resize(count);
+      uint32_t numUsed = FillObject(objectItems.data(), m_config, m_drawItemBits, *m_scene, i, solid, wire);
+      PadObject(objectItems.data(), m_config, m_drawItemBits, *m_scene, i, numUsed, count);
+
+      // state change stats are left as is, the object's state sequence rarely changes
+      for(uint32_t d = 0; d < count; d++)
+      {
+        const DrawItem& oldItem = drawItems[begin + d];
+        const DrawItem& newItem = objectItems[d];
+        stats.drawCalls += (newItem.count ? 1 : 0) - (oldItem.count ? 1 : 0);
+        stats.drawTriangles += newItem.count / 3 - oldItem.count / 3;
+      }
+
+      std::copy(objectItems.begin(), objectItems.end(), drawItems.begin() + begin);
+      if(count)
+      {
+        slots.push_back({begin, count});
+      }
+    }
+  }
+
+  // merge ranges of neighboring objects
+  std::sort(slots.begin(), slots.end(), [](const DrawSlots& a, const DrawSlots& b) { return a.begin < b.begin; });
+  size_t merged = 0;
+  for(size_t s = 0; s < slots.size(); s++)
   {
-    permutation[i] = i;
+    if(merged && slots[merged - 1].begin + slots[merged - 1].count >= slots[s].begin)
+    {
+      DrawSlots& last = slots[merged - 1];
+      last.count      = std::max(last.begin + last.count, slots[s].begin + slots[s].count) - last.begin;
+    }
+    else
+    {
+      slots[merged++] = slots[s];
+    }
   }
-  if(drawCount)
+  slots.resize(merged);
+
+  return true;
+}
+
+void Renderer::fillDrawInstances(std::vector<DrawItem>& drawItems, const DrawItemBits& bits, std::vector<DrawSlots>& draws)
+{
+  struct InstanceKey
   {
-    // not exactly a good way to generate random 32bit ;)
-    for(uint32_t i = drawCount - 1; i > 0; i--)
+    uint64_t state;  // without the matrix
+    uint32_t firstIndex;
+    uint32_t count;
+
+    bool operator==(const InstanceKey& other) const
     {
-      uint32_t r = 0;
-      r |= (rand() & 0xFF) << 0;
-      r |= (rand() & 0xFF) << 8;
-      r |= (rand() & 0xFF) << 16;
-      r |= (rand() & 0xFF) << 24;
+      return state == other.state && firstIndex == other.firstIndex && count == other.count;
+    }
+  };
 
-      uint32_t other = r % (i + 1);
-      std::swap(permutation[i], permutation[other]);
+  struct InstanceKeyHash
+  {
+    size_t operator()(const InstanceKey& key) const
+    {
+      return std::hash<uint64_t>()(key.state ^ ((uint64_t(key.firstIndex) << 32 | key.count) * 0x9e3779b97f4a7c15ULL));
     }
+  };
 
-    int shaderIndex      = -1;
-    stats.shaderBindings = 0;
-    for(uint32_t i = 0; i < drawCount; i++)
+  size_t numItems = drawItems.size();
+  draws.clear();
+
+  // draw per item in order of first occurrence
+  std::unordered_map<InstanceKey, uint32_t, InstanceKeyHash> lookup;
+  std::vector<uint32_t>                                     itemDraws(numItems);
+  lookup.reserve(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    const DrawItem& di  = drawItems[i];
+    InstanceKey     key = {di.state >> bits.materialShift, di.firstIndex, di.count};
+
+    auto it = lookup.find(key);
+    if(it == lookup.end())
     {
-      uint32_t idx = permutation[i];
-      if(drawItems[idx].shaderIndex != shaderIndex)
+      it = lookup.insert({key, uint32_t(draws.size())}).first;
+      draws.push_back({0, 0});
+    }
+    itemDraws[i] = it->second;
+    draws[it->second].count++;
+  }
+
+  uint32_t offset = 0;
+  for(DrawSlots& draw : draws)
+  {
+    draw.begin = offset;
+    offset += draw.count;
+  }
+
+  // stable scatter, instances keep their relative order
+  std::vector<DrawItem> instances(numItems);
+  std::vector<uint32_t> cursors(draws.size());
+  for(size_t d = 0; d < draws.size(); d++)
+  {
+    cursors[d] = draws[d].begin;
+  }
+  for(size_t i = 0; i < numItems; i++)
+  {
+    instances[cursors[itemDraws[i]]++] = drawItems[i];
+  }
+  drawItems.swap(instances);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+static uint32_t GetBitsFor(size_t numValues)
+{
+  uint32_t bits = 0;
+  while(bits < 64 && (uint64_t(1) << bits) < numValues)
+  {
+    bits++;
+  }
+  return bits;
+}
+
+Renderer::DrawItemBits Renderer::DrawItemBits::create(const CadScene* scene, uint32_t maxShaders)
+{
+  CadScene::IndexingBits indexing = scene->getIndexingBits();
+
+  DrawItemBits bits;
+  bits.shaders    = GetBitsFor(maxShaders);
+  bits.geometries = GetBitsFor(scene->m_geometry.size());
+  bits.materials  = indexing.materials;
+  bits.matrices   = indexing.matrices;
+
+  bits.materialShift = bits.matrices;
+  bits.geometryShift = bits.materialShift + bits.materials;
+  bits.shaderShift   = bits.geometryShift + bits.geometries;
+  bits.wireShift     = bits.shaderShift + bits.shaders;
+  return bits;
+}
+
+// LSD radix sort of keys with their indices, only numBits low bits of the keys are used
+static void RadixSortKeys(std::vector<uint64_t>& keys, std::vector<uint32_t>& indices, uint32_t numBits)
+{
+  const uint64_t mask     = (uint64_t(1) << s_radixBits) - 1;
+  size_t         numItems = keys.size();
+
+  std::vector<uint64_t> tempKeys(numItems);
+  std::vector<uint32_t> tempIndices(numItems);
+  std::vector<size_t>   histogram(size_t(1) << s_radixBits);
+
+  for(uint32_t shift = 0; shift < numBits; shift += s_radixBits)
+  {
+    std::fill(histogram.begin(), histogram.end(), 0);
+    for(size_t i = 0; i < numItems; i++)
+    {
+      histogram[(keys[i] >> shift) & mask]++;
+    }
+
+    // all keys share this digit
+    if(histogram[(keys[0] >> shift) & mask] == numItems)
+      continue;
+
+    size_t offset = 0;
+    for(size_t& count : histogram)
+    {
+      size_t current = count;
+      count          = offset;
+      offset += current;
+    }
+
+    for(size_t i = 0; i < numItems; i++)
+    {
+      size_t dst       = histogram[(keys[i] >> shift) & mask]++;
+      tempKeys[dst]    = keys[i];
+      tempIndices[dst] = indices[i];
+    }
+
+    keys.swap(tempKeys);
+    indices.swap(tempIndices);
+  }
+}
+
+void Renderer::sortDrawItems(std::vector<DrawItem>& drawItems)
+{
+  size_t numItems = drawItems.size();
+  if(!numItems)
+    return;
+
+  assert(numItems <= size_t(~uint32_t(0)));
+
+  std::vector<uint64_t> keys(numItems);
+  std::vector<uint32_t> indices(numItems);
+  uint64_t              usedBits = 0;
+  for(size_t i = 0; i < numItems; i++)
+  {
+    keys[i]    = drawItems[i].state;
+    indices[i] = uint32_t(i);
+    usedBits |= keys[i];
+  }
+
+  uint32_t numBits = 0;
+  while(numBits < 64 && (usedBits >> numBits))
+  {
+    numBits++;
+  }
+
+  RadixSortKeys(keys, indices, numBits);
+
+  // single gather of the full items
+  std::vector<DrawItem> sorted(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    sorted[i] = drawItems[indices[i]];
+  }
+  drawItems.swap(sorted);
+}
+
+// Greedy nearest-neighbour chaining over draws sorted by a key whose fields are ordered by cost.
+// Within each group the next sub-group is the one that continues the state of the previously
+// emitted draw: first one with the same value, then one that contains the same value for the next
+// cheaper field, else the next unused one in key order.
+class StateChainer
+{
+public:
+  struct Level
+  {
+    uint32_t shift;
+    uint64_t mask;
+  };
+
+  StateChainer(const std::vector<uint64_t>& keys, const std::vector<Level>& levels)
+      : m_keys(keys)
+      , m_levels(levels)
+      , m_scratch(levels.size())
+  {
+  }
+
+  // order receives positions into keys
+  void run(std::vector<uint32_t>& order)
+  {
+    order.clear();
+    order.reserve(m_keys.size());
+    m_order   = &order;
+    m_hasPrev = false;
+    if(!m_keys.empty())
+    {
+      chain(0, m_keys.size(), 0);
+    }
+  }
+
+private:
+  struct Group
+  {
+    uint64_t value;
+    size_t   begin;
+    size_t   end;
+  };
+
+  struct Child
+  {
+    uint64_t value;
+    uint32_t group;
+  };
+
+  struct Scratch
+  {
+    std::vector<Group>    groups;
+    std::vector<Child>    children;
+    std::vector<uint32_t> cursors;
+    std::vector<bool>     used;
+  };
+
+  const std::vector<uint64_t>& m_keys;
+  const std::vector<Level>&    m_levels;
+  std::vector<Scratch>         m_scratch;
+  std::vector<uint32_t>*       m_order   = nullptr;
+  uint64_t                     m_prev    = 0;
+  bool                         m_hasPrev = false;
+
+  uint64_t getField(uint64_t key, size_t level) const { return (key >> m_levels[level].shift) & m_levels[level].mask; }
+
+  void chain(size_t begin, size_t end, size_t level)
+  {
+    if(level == m_levels.size())
+    {
+      for(size_t i = begin; i < end; i++)
+      {
+        m_order->push_back(uint32_t(i));
+      }
+      m_prev    = m_keys[end - 1];
+      m_hasPrev = true;
+      return;
+    }
+
+    // children recurse into the next level's scratch only
+    Scratch& scratch = m_scratch[level];
+    scratch.groups.clear();
+    for(size_t i = begin; i < end;)
+    {
+      uint64_t value = getField(m_keys[i], level);
+      size_t   next  = i + 1;
+      while(next < end && getField(m_keys[next], level) == value)
       {
-        stats.shaderBindings++;
-        shaderIndex = drawItems[idx].shaderIndex;
+        next++;
       }
+      scratch.groups.push_back({value, i, next});
+      i = next;
     }
+
+    size_t numGroups = scratch.groups.size();
+    if(numGroups == 1)
+    {
+      chain(begin, end, level + 1);
+      return;
+    }
+
+    // which groups contain a value of the next level
+    bool hasChildren = level + 1 < m_levels.size();
+    scratch.children.clear();
+    if(hasChildren)
+    {
+      for(uint32_t g = 0; g < uint32_t(numGroups); g++)
+      {
+        uint64_t last = ~uint64_t(0);
+        for(size_t i = scratch.groups[g].begin; i < scratch.groups[g].end; i++)
+        {
+          uint64_t value = getField(m_keys[i], level + 1);
+          if(value != last)
+          {
+            scratch.children.push_back({value, g});
+            last = value;
+          }
+        }
+      }
+      std::sort(scratch.children.begin(), scratch.children.end(),
+                [](const Child& a, const Child& b) { return a.value < b.value || (a.value == b.value && a.group < b.group); });
+      scratch.cursors.resize(scratch.children.size());
+      for(uint32_t c = 0; c < uint32_t(scratch.children.size()); c++)
+      {
+        scratch.cursors[c] = c;
+      }
+    }
+
+    scratch.used.assign(numGroups, false);
+    size_t nextUnused = 0;
+
+    for(size_t n = 0; n < numGroups; n++)
+    {
+      size_t pick = numGroups;
+
+      if(m_hasPrev)
+      {
+        uint64_t value = getField(m_prev, level);
+        auto     it    = std::lower_bound(scratch.groups.begin(), scratch.groups.end(), value,
+                                          [](const Group& group, uint64_t v) { return group.value < v; });
+        if(it != scratch.groups.end() && it->value == value && !scratch.used[it - scratch.groups.begin()])
+        {
+          pick = it - scratch.groups.begin();
+        }
+      }
+
+      if(pick == numGroups && m_hasPrev && hasChildren)
+      {
+        uint64_t value = getField(m_prev, level + 1);
+        auto     it    = std::lower_bound(scratch.children.begin(), scratch.children.end(), value,
+                                          [](const Child& child, uint64_t v) { return child.value < v; });
+        size_t   first = it - scratch.children.begin();
+        if(first < scratch.children.size() && scratch.children[first].value == value)
+        {
+          // skip groups already used, the cursor of the first entry makes this amortized linear
+          uint32_t c = scratch.cursors[first];
+          while(c < scratch.children.size() && scratch.children[c].value == value && scratch.used[scratch.children[c].group])
+          {
+            c++;
+          }
+          scratch.cursors[first] = c;
+          if(c < scratch.children.size() && scratch.children[c].value == value)
+          {
+            pick = scratch.children[c].group;
+          }
+        }
+      }
+
+      if(pick == numGroups)
+      {
+        while(scratch.used[nextUnused])
+        {
+          nextUnused++;
+        }
+        pick = nextUnused;
+      }
+
+      scratch.used[pick] = true;
+      chain(scratch.groups[pick].begin, scratch.groups[pick].end, level + 1);
+    }
+  }
+};
+
+void Renderer::sortDrawItemsByCost(std::vector<DrawItem>& drawItems, const DrawItemBits& bits, BindingMode bindingMode, const StateCosts& costs)
+{
+  size_t numItems = drawItems.size();
+  if(!numItems)
+    return;
+
+  assert(numItems <= size_t(~uint32_t(0)));
+
+  struct Field
+  {
+    float    cost;
+    uint32_t shift;
+    uint32_t bits;
+  };
+
+  float uniformCost = 0;
+  if(bindingMode == BINDINGMODE_DSETS)
+    uniformCost = costs.descriptorOffset;
+  else if(bindingMode == BINDINGMODE_PUSHADDRESS)
+    uniformCost = costs.pushConstant;
+
+  // default order on equal costs
+  Field fields[4] = {{costs.shaderBind, bits.shaderShift, bits.shaders},
+                     {costs.bufferBind, bits.geometryShift, bits.geometries},
+                     {uniformCost, bits.materialShift, bits.materials},
+                     {uniformCost, 0, bits.matrices}};
+  std::stable_sort(fields, fields + 4, [](const Field& a, const Field& b) { return a.cost > b.cost; });
+
+  // repack the state so the most expensive change is the most significant after solid/wire
+  std::vector<StateChainer::Level> levels;
+  uint32_t                         keyShift = bits.getTotal() - 1;
+  levels.push_back({keyShift, 1});
+  for(const Field& field : fields)
+  {
+    keyShift -= field.bits;
+    levels.push_back({keyShift, (uint64_t(1) << field.bits) - 1});
+  }
+
+  std::vector<uint64_t> keys(numItems);
+  std::vector<uint32_t> indices(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    uint64_t state = drawItems[i].state;
+    uint64_t key   = ((state >> bits.wireShift) & 1) << levels[0].shift;
+    for(uint32_t f = 0; f < 4; f++)
+    {
+      key |= ((state >> fields[f].shift) & levels[f + 1].mask) << levels[f + 1].shift;
+    }
+    keys[i]    = key;
+    indices[i] = uint32_t(i);
+  }
+
+  RadixSortKeys(keys, indices, bits.getTotal());
+
+  std::vector<uint32_t> order;
+  StateChainer          chainer(keys, levels);
+  chainer.run(order);
+
+  std::vector<DrawItem> sorted(numItems);
+  for(size_t i = 0; i < numItems; i++)
+  {
+    sorted[i] = drawItems[indices[order[i]]];
+  }
+  drawItems.swap(sorted);
+}
+
+void Renderer::sortBenchmark(const CadScene* scene)
+{
+  Config config;
+  config.strategy    = STRATEGY_INDIVIDUAL;
+  config.bindingMode = BINDINGMODE_INDEX_VERTEXATTRIB;
+  config.objectFrom  = 0;
+  config.objectNum   = uint32_t(scene->getNumObjects());
+
+  Renderer              renderer;
+  Stats                 stats;
+  std::vector<DrawItem> sceneItems;
+  renderer.fillDrawItems(sceneItems, scene, config, stats);
+  if(sceneItems.empty())
+    return;
+
+  LOGI("sort benchmark: %zu scene draws, %d key bits\n", sceneItems.size(), renderer.m_drawItemBits.getTotal());
+
+  const size_t sizes[] = {1000000, 10000000};
+  for(size_t numItems : sizes)
+  {
+    // random picks from the scene draws in random order
+    std::mt19937          rng(1234);
+    std::vector<DrawItem> items(numItems);
+    for(size_t i = 0; i < numItems; i++)
+    {
+      items[i] = sceneItems[rng() % sceneItems.size()];
+    }
+
+    std::vector<DrawItem> reference = items;
+    auto                  begin     = std::chrono::steady_clock::now();
+    std::sort(reference.begin(), reference.end(), DrawItem_compare_groups);
+    double timeStd = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    begin = std::chrono::steady_clock::now();
+    sortDrawItems(items);
+    double timeRadix = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    // equal items may be ordered differently, so compare the keys
+    size_t mismatches = 0;
+    for(size_t i = 0; i < numItems; i++)
+    {
+      mismatches += items[i].state != reference[i].state ? 1 : 0;
+    }
+
+    LOGI("  %8zu draws: std::sort %9.2f ms, radix %9.2f ms, mismatches %zu\n", numItems, timeStd, timeRadix, mismatches);
+  }
+}
+
+// 32-bit integer hash with good avalanche, see "lowbias32" by Chris Wellons
+static uint32_t PermutationHash(uint32_t value)
+{
+  value ^= value >> 16;
+  value *= 0x7feb352dU;
+  value ^= value >> 15;
+  value *= 0x846ca68bU;
+  value ^= value >> 16;
+  return value;
+}
+
+// balanced Feistel network, a bijection on [0, 1 << (2 * halfBits))
+static uint32_t PermutationFeistel(uint32_t value, uint32_t halfBits, uint32_t seed)
+{
+  uint32_t mask  = (1U << halfBits) - 1;
+  uint32_t left  = value >> halfBits;
+  uint32_t right = value & mask;
+  for(uint32_t round = 0; round < s_permutationRounds; round++)
+  {
+    uint32_t next = left ^ (PermutationHash(right ^ (seed + round * 0x9e3779b9U)) & mask);
+    left          = right;
+    right         = next;
+  }
+  return (left << halfBits) | right;
+}
+
+void Renderer::fillRandomPermutation(uint32_t drawCount, uint32_t* permutation, const DrawItem* drawItems, Stats& stats)
+{
+  if(!drawCount)
+    return;
+
+  unsigned int numThreads = m_config.fillThreads ? m_config.fillThreads : ThreadPool::sysGetNumCores();
+  uint32_t     seed       = PermutationHash(m_config.permutationSeed);
+
+  // smallest power of 4 domain that holds all draws, at most 4x larger
+  uint32_t halfBits = 1;
+  while(halfBits < 16 && (uint64_t(1) << (halfBits * 2)) < drawCount)
+  {
+    halfBits++;
+  }
+
+  // Every element is computed independently from its index, cycle walking
+  // keeps the bijection within [0, drawCount).
+  ThreadPool::parallelBatches(drawCount, s_statsBatchSize, numThreads, [&](size_t begin, size_t end) {
+    for(size_t i = begin; i < end; i++)
+    {
+      uint32_t value = uint32_t(i);
+      do
+      {
+        value = PermutationFeistel(value, halfBits, seed);
+      } while(value >= drawCount);
+      permutation[i] = value;
+    }
+  });
+
+  size_t             numBatches = (drawCount + s_statsBatchSize - 1) / s_statsBatchSize;
+  std::vector<Stats> batchStats(numBatches);
+
+  ThreadPool::parallelBatches(drawCount, s_statsBatchSize, numThreads, [&](size_t begin, size_t end) {
+    Stats& batch = batchStats[begin / s_statsBatchSize];
+    for(size_t i = begin; i < end; i++)
+    {
+      AddStateChanges(batch, m_drawItemBits, m_config, i ? &drawItems[permutation[i - 1]] : nullptr, drawItems[permutation[i]]);
+    }
+  });
+
+  stats.shaderBindings    = 0;
+  stats.bufferBindings    = 0;
+  stats.pushConstants     = 0;
+  stats.descriptorOffsets = 0;
+  stats.stateCost         = 0;
+  for(const Stats& batch : batchStats)
+  {
+    stats.shaderBindings += batch.shaderBindings;
+    stats.bufferBindings += batch.bufferBindings;
+    stats.pushConstants += batch.pushConstants;
+    stats.descriptorOffsets += batch.descriptorOffsets;
+    stats.stateCost += batch.stateCost;
   }
 }
 
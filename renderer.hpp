@@ -22,6 +22,7 @@
 #define RENDERER_H__
 
 #include "resources_vk.hpp"
+#include <cmath>
 #include <nvh/profiler.hpp>
 
 // disable state filtering for buffer binds
@@ -41,15 +42,87 @@ enum Strategy
 class Renderer
 {
 public:
+  // bucket 0 counts latencies below 0.25 us, bucket i those below 0.25 * 2^i us,
+  // the last bucket everything above
+  struct LatencyHistogram
+  {
+    static const uint32_t NUM_BUCKETS = 16;
+
+    uint32_t buckets[NUM_BUCKETS] = {};
+
+    static double getBucketLimit(uint32_t bucket) { return 0.25 * double(1 << bucket); }
+
+    void add(double microseconds)
+    {
+      uint32_t bucket = 0;
+      while(bucket + 1 < NUM_BUCKETS && microseconds >= getBucketLimit(bucket))
+      {
+        bucket++;
+      }
+      buckets[bucket]++;
+    }
+
+    void add(const LatencyHistogram& other)
+    {
+      for(uint32_t i = 0; i < NUM_BUCKETS; i++)
+      {
+        buckets[i] += other.buckets[i];
+      }
+    }
+
+    uint32_t getCount() const
+    {
+      uint32_t count = 0;
+      for(uint32_t i = 0; i < NUM_BUCKETS; i++)
+      {
+        count += buckets[i];
+      }
+      return count;
+    }
+
+    // upper limit of the bucket the percentile falls into
+    double getPercentile(double percentile) const
+    {
+      uint32_t count     = getCount();
+      uint32_t threshold = uint32_t(std::ceil(double(count) * percentile));
+      uint32_t sum       = 0;
+      for(uint32_t i = 0; i < NUM_BUCKETS; i++)
+      {
+        sum += buckets[i];
+        if(sum && sum >= threshold)
+          return getBucketLimit(i);
+      }
+      return 0;
+    }
+  };
+
   struct Stats
   {
-    uint32_t drawCalls        = 0;
-    uint32_t drawTriangles    = 0;
-    uint32_t shaderBindings   = 0;
-    uint32_t sequences        = 0;
-    uint32_t preprocessSizeKB = 0;
-    uint32_t indirectSizeKB   = 0;
-    uint32_t cmdBuffers       = 0;
+    uint32_t drawCalls         = 0;
+    uint32_t drawTriangles     = 0;
+    uint32_t shaderBindings    = 0;
+    uint32_t bufferBindings    = 0;
+    uint32_t pushConstants     = 0;
+    uint32_t descriptorOffsets = 0;
+    float    stateCost         = 0;  // weighted by Config::stateCosts
+    uint32_t sequences         = 0;
+    uint32_t preprocessSizeKB  = 0;
+    uint32_t indirectSizeKB    = 0;
+    uint32_t cmdBuffers        = 0;
+
+    // threaded renderer, last measurement period
+    // wake: frame start until a worker runs, handoff: secondaries enqueued until the main thread got them
+    LatencyHistogram wakeLatency;
+    LatencyHistogram handoffLatency;
+  };
+
+  // relative cost of a single state change during serial recording
+  struct StateCosts
+  {
+    float shaderBind       = 8.0f;  // pipeline or shader objects
+    float bufferBind       = 2.0f;  // index and vertex buffer
+    float pushConstant     = 1.0f;  // BINDINGMODE_PUSHADDRESS matrix or material
+    float descriptorOffset = 1.5f;  // BINDINGMODE_DSETS matrix or material
   };
 
   struct Config
@@ -60,35 +133,78 @@ public:
     uint32_t    objectNum;
     uint32_t    maxShaders = 16;
     uint32_t    workerThreads;
-    bool        interleaved = false;
-    bool        sorted      = false;
-    bool        unordered   = false;
-    bool        permutated  = false;
-    bool        binned      = false;
-    bool        shaderObjs  = false;
+    uint32_t    fillThreads     = 0;  // fillDrawItems and fillRandomPermutation, 0 uses all cores
+    uint32_t    permutationSeed = 634523;
+    bool        interleaved     = false;
+    bool        sorted          = false;
+    bool        unordered       = false;
+    bool        permutated      = false;
+    bool        binned          = false;
+    bool        shaderObjs      = false;
+    bool        costSorted      = false;  // with sorted, minimize stateCosts instead of the fixed order
+    bool        instanced       = false;  // BINDINGMODE_INDEX_VERTEXATTRIB, draws that only differ in the matrix become instances
+    bool        workerSpin      = true;   // threaded, spin before parking on frame start and handoff
+    StateCosts  stateCosts;
+    // reserve fixed draw slots per object so part visibility changes can be
+    // patched in place (ignored when sorted or permutated)
+    bool partUpdates = false;
   };
 
+  // 16 bytes, so large draw lists stay cache friendly.
+  // state holds the bit-packed indices, see DrawItemBits, and sorts like
+  // the field-wise order: solid before wire, shader, geometry, material, matrix
   struct DrawItem
   {
-    bool                solid;
-    int                 materialIndex;
-    int                 geometryIndex;
-    int                 matrixIndex;
-    int                 shaderIndex;
-    CadScene::DrawRange range;
+    uint64_t state;
+    uint32_t firstIndex;
+    uint32_t count;
   };
 
-  static inline bool DrawItem_compare_groups(const DrawItem& a, const DrawItem& b)
+  // bit widths of DrawItem::state, sized from the scene
+  struct DrawItemBits
   {
-    int diff = 0;
-    diff     = diff != 0 ? diff : (a.solid == b.solid ? 0 : (a.solid ? -1 : 1));
-    diff     = diff != 0 ? diff : (a.shaderIndex - b.shaderIndex);
-    diff     = diff != 0 ? diff : (a.geometryIndex - b.geometryIndex);
-    diff     = diff != 0 ? diff : (a.materialIndex - b.materialIndex);
-    diff     = diff != 0 ? diff : (a.matrixIndex - b.matrixIndex);
-
-    return diff < 0;
-  }
+    uint32_t shaders    = 0;
+    uint32_t geometries = 0;
+    uint32_t materials  = 0;
+    uint32_t matrices   = 0;
+
+    uint32_t materialShift = 0;
+    uint32_t geometryShift = 0;
+    uint32_t shaderShift   = 0;
+    uint32_t wireShift     = 0;
+
+    static DrawItemBits create(const CadScene* scene, uint32_t maxShaders);
+
+    // including the solid/wire bit
+    uint32_t getTotal() const { return wireShift + 1; }
+
+    uint64_t pack(bool solid, int shaderIndex, int geometryIndex, int materialIndex, int matrixIndex) const
+    {
+      return (uint64_t(solid ? 0 : 1) << wireShift) | (uint64_t(shaderIndex) << shaderShift)
+             | (uint64_t(geometryIndex) << geometryShift) | (uint64_t(materialIndex) << materialShift) | uint64_t(matrixIndex);
+    }
+
+    bool isSolid(const DrawItem& di) const { return ((di.state >> wireShift) & 1) == 0; }
+    int  getShaderIndex(const DrawItem& di) const { return getField(di, shaderShift, shaders); }
+    int  getGeometryIndex(const DrawItem& di) const { return getField(di, geometryShift, geometries); }
+    int  getMaterialIndex(const DrawItem& di) const { return getField(di, materialShift, materials); }
+    int  getMatrixIndex(const DrawItem& di) const { return getField(di, 0, matrices); }
+
+  private:
+    static int getField(const DrawItem& di, uint32_t shift, uint32_t bits)
+    {
+      return int((di.state >> shift) & ((uint64_t(1) << bits) - 1));
+    }
+  };
+
+  // contiguous range of draw items
+  struct DrawSlots
+  {
+    uint32_t begin;
+    uint32_t count;
+  };
+
+  static inline bool DrawItem_compare_groups(const DrawItem& a, const DrawItem& b) { return a.state < b.state; }
 
   class Type
   {
@@ -103,6 +219,7 @@ public:
     virtual uint32_t    supportedBindingModes() const { return 0xFF; }
     virtual bool        supportsShaderObjs() const { return true; }
     virtual uint32_t    supportedShaderBinds() const { return ~0; }
+    virtual bool        supportsInstancing() const { return true; }
   };
 
   typedef std::vector<Type*> Registry;
@@ -117,14 +234,46 @@ public:
   virtual void init(const CadScene* scene, ResourcesVK* resources, const Config& config, Stats& stats) {}
   virtual void deinit() {}
   virtual void draw(const Resources::Global& global, Stats& stats) {}
+  // objects are scene objects whose parts were toggled via CadScene::setPartActive,
+  // returns false if the renderer cannot patch its draw items and must be re-initialized.
+  // The caller must ensure the gpu no longer uses previous frames.
+  virtual bool updateParts(const std::vector<uint32_t>& objects, Stats& stats) { return false; }
 
   virtual ~Renderer() {}
 
   void fillDrawItems(std::vector<DrawItem>& drawItems, const CadScene* scene, const Config& config, Stats& stats);
+  // deterministic for Config::permutationSeed, independent of the platform and thread count
   void fillRandomPermutation(uint32_t drawCount, uint32_t* permutation, const DrawItem* drawItems, Stats& stats);
+  // same order as DrawItem_compare_groups, radix sorts the state keys, equal items keep their relative order
+  static void sortDrawItems(std::vector<DrawItem>& drawItems);
+  // greedy nearest-neighbour chaining of the draw items that minimizes the weighted state changes,
+  // solid items still come before wire items
+  static void sortDrawItemsByCost(std::vector<DrawItem>& drawItems, const DrawItemBits& bits, BindingMode bindingMode, const StateCosts& costs);
+  // times std::sort against the radix sort for 1M and 10M draws made from the scene's parts
+  static void sortBenchmark(const CadScene* scene);
+  // with reserved slots refills the draw items of the given scene objects (and their instanced clones),
+  // slots receives the modified ranges in ascending order
+  bool updateDrawItems(std::vector<DrawItem>& drawItems, const std::vector<uint32_t>& objects, std::vector<DrawSlots>& slots, Stats& stats);
+  bool hasDrawSlots() const { return !m_objectDrawSlots.empty(); }
+  // moves draw items that only differ in their matrix next to each other, in order of first occurrence,
+  // draws receives one range per instanced draw
+  static void fillDrawInstances(std::vector<DrawItem>& drawItems, const DrawItemBits& bits, std::vector<DrawSlots>& draws);
+  // number of draw calls for drawCount draw items, and the items of draw call i,
+  // instance k of a draw uses the combined indices of draw item begin + k
+  size_t    getInstancedDrawCount(size_t drawCount) const { return m_drawInstances.empty() ? drawCount : m_drawInstances.size(); }
+  DrawSlots getInstancedDraw(size_t i) const { return m_drawInstances.empty() ? DrawSlots{uint32_t(i), 1} : m_drawInstances[i]; }
 
   Config          m_config;
   const CadScene* m_scene;
+  // set by fillDrawItems
+  DrawItemBits m_drawItemBits;
+
+  // filled by fillDrawItems if Config::partUpdates is used, first draw item of
+  // every object relative to Config::objectFrom, plus the total count.
+  // Inactive parts keep their slot with an empty range.
+  std::vector<uint32_t> m_objectDrawSlots;
+  // filled by fillDrawItems if Config::instanced is used
+  std::vector<DrawSlots> m_drawInstances;
 };
 }  // namespace generatedcmds
 
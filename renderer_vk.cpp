@@ -85,6 +85,9 @@ private:
     int lastMatrix   = -1;
     int lastObject   = -1;
     int lastShader   = -1;
+#if USE_DRAW_OFFSETS
+    VkIndexType lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
+#endif
 
     VkDeviceAddress matrixAddress   = scene.m_buffers.matrices.address;
     VkDeviceAddress materialAddress = scene.m_buffers.materials.address;
@@ -138,58 +141,74 @@ private:
       vkCmdBindShadersEXT(cmd, 3, unusedStages, nullptr);
     }
 
-    for(size_t i = 0; i < drawCount; i++)
+    size_t numDraws = getInstancedDrawCount(drawCount);
+    for(size_t d = 0; d < numDraws; d++)
     {
-      uint32_t        idx = m_config.permutated ? m_seqIndices[i] : uint32_t(i);
-      const DrawItem& di  = drawItems[idx];
-
-      if(di.shaderIndex != lastShader)
+      // instances are never permutated
+      DrawSlots       draw = getInstancedDraw(d);
+      size_t          i    = draw.begin;
+      uint32_t        idx  = m_config.permutated ? m_seqIndices[i] : uint32_t(i);
+      const DrawItem& di   = drawItems[idx];
+
+      // reserved slot of an inactive part
+      if(!di.count)
+        continue;
+
+      int shaderIndex   = m_drawItemBits.getShaderIndex(di);
+      int geometryIndex = m_drawItemBits.getGeometryIndex(di);
+      int materialIndex = m_drawItemBits.getMaterialIndex(di);
+      int matrixIndex   = m_drawItemBits.getMatrixIndex(di);
+
+      if(shaderIndex != lastShader)
       {
         if(m_config.shaderObjs)
         {
           VkShaderStageFlagBits stages[2]  = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
-          VkShaderEXT           shaders[2] = {res->m_drawShading.vertexShaderObjs[di.shaderIndex],
-                                              res->m_drawShading.fragmentShaderObjs[di.shaderIndex]};
+          VkShaderEXT           shaders[2] = {res->m_drawShading.vertexShaderObjs[shaderIndex],
+                                              res->m_drawShading.fragmentShaderObjs[shaderIndex]};
           vkCmdBindShadersEXT(cmd, 2, stages, shaders);
         }
         else
         {
-          vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawShading.pipelines[di.shaderIndex]);
+          vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawShading.pipelines[shaderIndex]);
         }
 
-        lastShader = di.shaderIndex;
+        lastShader = shaderIndex;
       }
 
 #if USE_DRAW_OFFSETS
-      if(lastGeometry != int(scene.m_geometry[di.geometryIndex].allocation.chunkIndex))
+      // geometries within a chunk can use different index types
+      if(lastGeometry != int(scene.m_geometry[geometryIndex].allocation.chunkIndex)
+         || lastIndexType != scene.m_geometry[geometryIndex].indexType)
       {
-        const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
+        const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
 
-        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, 0, geo.indexType);
         VkDeviceSize offset = {0};
         VkDeviceSize size   = {VK_WHOLE_SIZE};
-        VkDeviceSize stride = {sizeof(CadScene::Vertex)};
+        VkDeviceSize stride = {scene.m_vertexSize};
 #if USE_DYNAMIC_VERTEX_STRIDE
         vkCmdBindVertexBuffers2(cmd, 0, 1, &geo.vbo.buffer, &offset, &size, &stride);
 #else
         vkCmdBindVertexBuffers(cmd, 0, 1, &geo.vbo.buffer, &offset);
 #endif
-        lastGeometry = int(scene.m_geometry[di.geometryIndex].allocation.chunkIndex);
+        lastGeometry  = int(scene.m_geometry[geometryIndex].allocation.chunkIndex);
+        lastIndexType = geo.indexType;
       }
 #else
-      if(lastGeometry != di.geometryIndex)
+      if(lastGeometry != geometryIndex)
       {
-        const CadSceneVK::Geometry& geo    = scene.m_geometry[di.geometryIndex];
-        VkDeviceSize                stride = {sizeof(CadScene::Vertex)};
+        const CadSceneVK::Geometry& geo    = scene.m_geometry[geometryIndex];
+        VkDeviceSize                stride = {scene.m_vertexSize};
 
-        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, geo.ibo.offset, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, geo.ibo.offset, geo.indexType);
 #if USE_DYNAMIC_VERTEX_STRIDE
         vkCmdBindVertexBuffers2(cmd, 0, 1, &geo.vbo.buffer, &geo.vbo.offset, &geo.vbo.range, &stride);
 #else
         vkCmdBindVertexBuffers(cmd, 0, 1, &geo.vbo.buffer, &geo.vbo.offset);
 #endif
 
-        lastGeometry = di.geometryIndex;
+        lastGeometry = geometryIndex;
       }
 #endif
 
@@ -197,63 +216,67 @@ private:
 
       if(bindingMode == BINDINGMODE_DSETS)
       {
-        if(lastMatrix != di.matrixIndex)
+        if(lastMatrix != matrixIndex)
         {
-          uint32_t offset = di.matrixIndex * res->m_alignedMatrixSize;
+          uint32_t offset = matrixIndex * res->m_alignedMatrixSize;
           vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawBind.getPipeLayout(),
                                   DRAW_UBO_MATRIX, 1, res->m_drawBind.at(DRAW_UBO_MATRIX).getSets(), 1, &offset);
-          lastMatrix = di.matrixIndex;
+          lastMatrix = matrixIndex;
         }
 
-        if(lastMaterial != di.materialIndex)
+        if(lastMaterial != materialIndex)
         {
-          uint32_t offset = di.materialIndex * res->m_alignedMaterialSize;
+          uint32_t offset = materialIndex * res->m_alignedMaterialSize;
           vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawBind.getPipeLayout(),
                                   DRAW_UBO_MATERIAL, 1, res->m_drawBind.at(DRAW_UBO_MATERIAL).getSets(), 1, &offset);
-          lastMaterial = di.materialIndex;
+          lastMaterial = materialIndex;
         }
       }
       else if(bindingMode == BINDINGMODE_PUSHADDRESS)
       {
-        if(lastMatrix != di.matrixIndex)
+        if(lastMatrix != matrixIndex)
         {
-          VkDeviceAddress address = matrixAddress + sizeof(CadScene::MatrixNode) * di.matrixIndex;
+          VkDeviceAddress address = matrixAddress + sizeof(CadScene::MatrixNode) * matrixIndex;
 
           vkCmdPushConstants(cmd, res->m_drawPush.getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &address);
 
-          lastMatrix = di.matrixIndex;
+          lastMatrix = matrixIndex;
         }
 
-        if(lastMaterial != di.materialIndex)
+        if(lastMaterial != materialIndex)
         {
-          VkDeviceAddress address = materialAddress + sizeof(CadScene::Material) * di.materialIndex;
+          VkDeviceAddress address = materialAddress + sizeof(CadScene::Material) * materialIndex;
 
           vkCmdPushConstants(cmd, res->m_drawPush.getPipeLayout(), VK_SHADER_STAGE_FRAGMENT_BIT,
                              sizeof(VkDeviceAddress), sizeof(VkDeviceAddress), &address);
 
-          lastMaterial = di.materialIndex;
+          lastMaterial = materialIndex;
         }
       }
       else if(bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
       {
-        firstInstance = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        firstInstance = m_indexingBits.packIndices(matrixIndex, materialIndex);
       }
       else if(bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
       {
         firstInstance             = i;
-        combinedIndicesMapping[i] = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        combinedIndicesMapping[i] = m_indexingBits.packIndices(matrixIndex, materialIndex);
+        for(uint32_t k = 1; k < draw.count; k++)
+        {
+          combinedIndicesMapping[i + k] = m_indexingBits.packIndices(m_drawItemBits.getMatrixIndex(drawItems[i + k]), materialIndex);
+        }
       }
 
       // drawcall
 #if USE_DRAW_OFFSETS
-      const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
-      vkCmdDrawIndexed(cmd, di.range.count, 1, uint32_t(di.range.offset + geo.ibo.offset / sizeof(uint32_t)),
-                       geo.vbo.offset / sizeof(CadScene::Vertex), firstInstance);
+      const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
+      vkCmdDrawIndexed(cmd, di.count, draw.count, di.firstIndex + uint32_t(geo.ibo.offset / geo.indexSize),
+                       geo.vbo.offset / scene.m_vertexSize, firstInstance);
 #else
-      vkCmdDrawIndexed(cmd, di.range.count, 1, uint32_t(di.range.offset / sizeof(uint32_t)), 0, firstInstance);
+      vkCmdDrawIndexed(cmd, di.count, draw.count, di.firstIndex, 0, firstInstance);
 #endif
 
-      lastShader = di.shaderIndex;
+      lastShader = shaderIndex;
     }
   }
 
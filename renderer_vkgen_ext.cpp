@@ -152,6 +152,7 @@ public:
   void init(const CadScene* scene, ResourcesVK* resources, const Renderer::Config& config, Stats& stats) override;
   void deinit() override;
   void draw(const Resources::Global& global, Stats& stats) override;
+  bool updateParts(const std::vector<uint32_t>& objects, Stats& stats) override;
 
 
   RendererVKGenEXT() {}
@@ -224,6 +225,9 @@ private:
   DrawSetup                 m_draw;
   VkIndirectExecutionSetEXT m_indirectExecutionSet = nullptr;
 
+  // kept for part updates, sequence i is m_drawItems[i]
+  std::vector<DrawItem> m_drawItems;
+
   VkGeneratedCommandsInfoEXT getGeneratedCommandsInfo();
 
   void cmdStates(VkCommandBuffer cmd);
@@ -240,12 +244,12 @@ private:
 
   void setupInputInterleaved(const DrawItem* drawItems, size_t drawCount, Stats& stats)
   {
-    ResourcesVK*      res   = m_resources;
-    const CadSceneVK& scene = res->m_scene;
+    ResourcesVK* res = m_resources;
 
     ScopeStaging staging(res->m_resourceAllocator, res->m_queue, res->m_queueFamily);
 
-    m_draw.sequencesCount = drawCount;
+    size_t sequencesCount = getInstancedDrawCount(drawCount);
+    m_draw.sequencesCount = uint32_t(sequencesCount);
 
     // compute input buffer space requirements
     VkPhysicalDeviceProperties2 phyProps = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
@@ -254,7 +258,7 @@ private:
     vkGetPhysicalDeviceProperties2(res->m_physical, &phyProps);
 
     // create input buffer
-    m_draw.inputSize = sizeof(DrawSequence) * drawCount;
+    m_draw.inputSize = sizeof(DrawSequence) * sequencesCount;
     m_draw.inputSize += 32;  // if drawCount == 0
     m_draw.inputBuffer    = res->m_resourceAllocator.createBuffer(m_draw.inputSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT
                                                                                         | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
@@ -271,9 +275,6 @@ private:
 
     // prepare filling
 
-    VkDeviceAddress matrixAddress   = scene.m_buffers.matrices.address;
-    VkDeviceAddress materialAddress = scene.m_buffers.materials.address;
-
     std::vector<uint32_t> seqIndices;
     if(m_config.permutated)
     {
@@ -283,66 +284,89 @@ private:
 
     // fill sequence
     DrawSequence* sequences = (DrawSequence*)inputMapping;
-    for(size_t i = 0; i < drawCount; i++)
+    for(size_t i = 0; i < sequencesCount; i++)
     {
-      const uint32_t seqIndex = seqIndices.size() ? seqIndices[i] : i;
+      // instances are never permutated
+      DrawSlots      draw     = getInstancedDraw(i);
+      const uint32_t seqIndex = seqIndices.size() ? seqIndices[i] : draw.begin;
 
-      const DrawItem&             di  = drawItems[seqIndex];
-      const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
+      fillSequence(sequences[i], &drawItems[seqIndex], draw.count, draw.begin,
+                   combinedIndicesMapping ? &combinedIndicesMapping[draw.begin] : nullptr);
+    }
+  }
 
-      DrawSequence& seq = sequences[i];
+  // instances are consecutive draw items that only differ in their matrix,
+  // combinedIndices receives one entry per instance starting at firstInstance
+  void fillSequence(DrawSequence& seq, const DrawItem* instances, uint32_t instanceCount, uint32_t firstInstance, uint32_t* combinedIndices)
+  {
+    ResourcesVK*      res   = m_resources;
+    const CadSceneVK& scene = res->m_scene;
 
-      if(m_config.shaderObjs)
-      {
-        seq.shaderVertex   = di.shaderIndex * 2 + 0;
-        seq.shaderFragment = di.shaderIndex * 2 + 1;
-      }
-      else
-      {
-        seq.pipeline = di.shaderIndex;
-      }
+    VkDeviceAddress matrixAddress   = scene.m_buffers.matrices.address;
+    VkDeviceAddress materialAddress = scene.m_buffers.materials.address;
 
-      assert(di.shaderIndex < m_config.maxShaders);
+    const DrawItem& di = instances[0];
 
-      seq.ibo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.ibo.buffer);
-      seq.ibo.indexType     = VK_INDEX_TYPE_UINT32;
+    int shaderIndex   = m_drawItemBits.getShaderIndex(di);
+    int geometryIndex = m_drawItemBits.getGeometryIndex(di);
+    int materialIndex = m_drawItemBits.getMaterialIndex(di);
+    int matrixIndex   = m_drawItemBits.getMatrixIndex(di);
 
-      seq.vbo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.vbo.buffer);
-      seq.vbo.stride        = sizeof(CadScene::Vertex);
+    const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
+
+    if(m_config.shaderObjs)
+    {
+      seq.shaderVertex   = shaderIndex * 2 + 0;
+      seq.shaderFragment = shaderIndex * 2 + 1;
+    }
+    else
+    {
+      seq.pipeline = shaderIndex;
+    }
+
+    assert(shaderIndex < m_config.maxShaders);
+
+    seq.ibo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.ibo.buffer);
+    seq.ibo.indexType     = geo.indexType;
+
+    seq.vbo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.vbo.buffer);
+    seq.vbo.stride        = scene.m_vertexSize;
 
 #if USE_DRAW_OFFSETS
-      seq.ibo.size = scene.m_geometryMem.getChunk(geo.allocation).iboSize;
-      seq.vbo.size = scene.m_geometryMem.getChunk(geo.allocation).vboSize;
+    seq.ibo.size = scene.m_geometryMem.getChunk(geo.allocation).iboSize;
+    seq.vbo.size = scene.m_geometryMem.getChunk(geo.allocation).vboSize;
 #else
-      seq.ibo.bufferAddress += geo.ibo.offset;
-      seq.vbo.bufferAddress += geo.vbo.offset;
+    seq.ibo.bufferAddress += geo.ibo.offset;
+    seq.vbo.bufferAddress += geo.vbo.offset;
 
-      seq.ibo.size = geo.ibo.range;
-      seq.vbo.size = geo.vbo.range;
+    seq.ibo.size = geo.ibo.range;
+    seq.vbo.size = geo.vbo.range;
 #endif
 
-      seq.pushMatrix   = matrixAddress + sizeof(CadScene::MatrixNode) * di.matrixIndex;
-      seq.pushMaterial = materialAddress + sizeof(CadScene::Material) * di.materialIndex;
+    seq.pushMatrix   = matrixAddress + sizeof(CadScene::MatrixNode) * matrixIndex;
+    seq.pushMaterial = materialAddress + sizeof(CadScene::Material) * materialIndex;
 
-      seq.drawIndexed.indexCount    = di.range.count;
-      seq.drawIndexed.instanceCount = 1;
-      seq.drawIndexed.firstInstance = 0;
-      seq.drawIndexed.firstIndex    = uint32_t(di.range.offset / sizeof(uint32_t));
-      seq.drawIndexed.vertexOffset  = 0;
+    seq.drawIndexed.indexCount    = di.count;
+    seq.drawIndexed.instanceCount = instanceCount;
+    seq.drawIndexed.firstInstance = 0;
+    seq.drawIndexed.firstIndex    = di.firstIndex;
+    seq.drawIndexed.vertexOffset  = 0;
 #if USE_DRAW_OFFSETS
-      seq.drawIndexed.firstIndex += geo.ibo.offset / sizeof(uint32_t);
+    seq.drawIndexed.firstIndex += geo.ibo.offset / geo.indexSize;
 #endif
 #if USE_DRAW_OFFSETS
-      seq.drawIndexed.vertexOffset += geo.vbo.offset / sizeof(CadScene::Vertex);
+    seq.drawIndexed.vertexOffset += geo.vbo.offset / scene.m_vertexSize;
 #endif
-      if(m_config.bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
-      {
-        seq.drawIndexed.firstInstance = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
-      }
-      else if(m_config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
+    if(m_config.bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
+    {
+      seq.drawIndexed.firstInstance = m_indexingBits.packIndices(matrixIndex, materialIndex);
+    }
+    else if(m_config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
+    {
+      seq.drawIndexed.firstInstance = firstInstance;
+      for(uint32_t k = 0; k < instanceCount; k++)
       {
-        seq.drawIndexed.firstInstance = i;
-        combinedIndicesMapping[i]     = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        combinedIndices[k] = m_indexingBits.packIndices(m_drawItemBits.getMatrixIndex(instances[k]), materialIndex);
       }
     }
   }
@@ -403,12 +427,21 @@ private:
     seqBinned.reserve(drawCount);
 
     VkDrawIndexedIndirectCommand* drawIndirects = (VkDrawIndexedIndirectCommand*)indirectMapping;
-    for(size_t i = 0; i < drawCount; i++)
+    size_t                        numDraws      = getInstancedDrawCount(drawCount);
+    for(size_t i = 0; i < numDraws; i++)
     {
-      const uint32_t seqIndex = seqIndices.size() ? seqIndices[i] : i;
+      // instances are never permutated
+      DrawSlots      draw     = getInstancedDraw(i);
+      const uint32_t seqIndex = seqIndices.size() ? seqIndices[i] : draw.begin;
+
+      const DrawItem& di = drawItems[seqIndex];
+
+      int shaderIndex   = m_drawItemBits.getShaderIndex(di);
+      int geometryIndex = m_drawItemBits.getGeometryIndex(di);
+      int materialIndex = m_drawItemBits.getMaterialIndex(di);
+      int matrixIndex   = m_drawItemBits.getMatrixIndex(di);
 
-      const DrawItem&             di  = drawItems[seqIndex];
-      const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
+      const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
 
       DrawSequenceBinned seq = {0};
 
@@ -416,27 +449,27 @@ private:
       {
         if(m_config.shaderObjs)
         {
-          seq.shaderVertex   = di.shaderIndex * 2 + 0;
-          seq.shaderFragment = di.shaderIndex * 2 + 1;
+          seq.shaderVertex   = shaderIndex * 2 + 0;
+          seq.shaderFragment = shaderIndex * 2 + 1;
         }
         else
         {
-          seq.pipeline = di.shaderIndex;
+          seq.pipeline = shaderIndex;
         }
       }
 
       seq.ibo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.ibo.buffer);
       seq.ibo.size          = scene.m_geometryMem.getChunk(geo.allocation).iboSize;
-      seq.ibo.indexType     = VK_INDEX_TYPE_UINT32;
+      seq.ibo.indexType     = geo.indexType;
 
       seq.vbo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.vbo.buffer);
       seq.vbo.size          = scene.m_geometryMem.getChunk(geo.allocation).vboSize;
-      seq.vbo.stride        = sizeof(CadScene::Vertex);
+      seq.vbo.stride        = scene.m_vertexSize;
 
       if(m_config.bindingMode == BINDINGMODE_PUSHADDRESS)
       {
-        seq.pushMatrix   = matrixAddress + sizeof(CadScene::MatrixNode) * di.matrixIndex;
-        seq.pushMaterial = materialAddress + sizeof(CadScene::Material) * di.materialIndex;
+        seq.pushMatrix   = matrixAddress + sizeof(CadScene::MatrixNode) * matrixIndex;
+        seq.pushMaterial = materialAddress + sizeof(CadScene::Material) * materialIndex;
       }
 
       if(seqDrawCount && (memcmp(&lastSeq, &seq, sizeof(seq)) != 0))
@@ -455,22 +488,26 @@ private:
       lastSeq = seq;
 
       VkDrawIndexedIndirectCommand& drawIndexed = drawIndirects[i];
-      drawIndexed.indexCount                    = di.range.count;
-      drawIndexed.instanceCount                 = 1;
+      drawIndexed.indexCount                    = di.count;
+      drawIndexed.instanceCount                 = draw.count;
       drawIndexed.firstInstance                 = 0;
-      drawIndexed.firstIndex                    = uint32_t(di.range.offset / sizeof(uint32_t));
+      drawIndexed.firstIndex                    = di.firstIndex;
       drawIndexed.vertexOffset                  = 0;
-      drawIndexed.firstIndex += geo.ibo.offset / sizeof(uint32_t);
-      drawIndexed.vertexOffset += geo.vbo.offset / sizeof(CadScene::Vertex);
+      drawIndexed.firstIndex += geo.ibo.offset / geo.indexSize;
+      drawIndexed.vertexOffset += geo.vbo.offset / scene.m_vertexSize;
 
       if(m_config.bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
       {
-        drawIndexed.firstInstance = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        drawIndexed.firstInstance = m_indexingBits.packIndices(matrixIndex, materialIndex);
       }
       else if(m_config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
       {
-        drawIndexed.firstInstance = i;
-        combinedIndicesMapping[i] = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        drawIndexed.firstInstance = draw.begin;
+        for(uint32_t k = 0; k < draw.count; k++)
+        {
+          combinedIndicesMapping[draw.begin + k] =
+              m_indexingBits.packIndices(m_drawItemBits.getMatrixIndex(drawItems[seqIndex + k]), materialIndex);
+        }
       }
 
       seqDrawCount++;
@@ -784,8 +821,7 @@ void RendererVKGenEXT::init(const CadScene* scene, ResourcesVK* resources, const
 
   stats.cmdBuffers = 1;
 
-  std::vector<DrawItem> drawItems;
-  fillDrawItems(drawItems, scene, config, stats);
+  fillDrawItems(m_drawItems, scene, config, stats);
 
   res->initPipelinesOrShaders(m_config.bindingMode,
                               m_config.maxShaders > 1 ? VK_PIPELINE_CREATE_2_INDIRECT_BINDABLE_BIT_EXT : 0, m_config.shaderObjs);
@@ -798,14 +834,20 @@ void RendererVKGenEXT::init(const CadScene* scene, ResourcesVK* resources, const
   initIndirectCommandsLayout(config);
   if(config.binned)
   {
-    setupInputBinned(drawItems.data(), drawItems.size(), stats);
+    setupInputBinned(m_drawItems.data(), m_drawItems.size(), stats);
   }
   else
   {
-    setupInputInterleaved(drawItems.data(), drawItems.size(), stats);
+    setupInputInterleaved(m_drawItems.data(), m_drawItems.size(), stats);
   }
   setupPreprocess(stats);
 
+  if(config.binned || !hasDrawSlots())
+  {
+    m_drawItems.clear();
+    m_drawItems.shrink_to_fit();
+  }
+
   if(m_mode == MODE_PREPROCESS)
   {
     initStateCommandBuffer();
@@ -822,6 +864,43 @@ void RendererVKGenEXT::deinit()
   deleteData();
   deinitIndirectCommandsLayout();
   vkDestroyIndirectExecutionSetEXT(m_resources->m_device, m_indirectExecutionSet, nullptr);
+
+  m_drawItems.clear();
+}
+
+bool RendererVKGenEXT::updateParts(const std::vector<uint32_t>& objects, Stats& stats)
+{
+  // binned inputs are merged by state, they would need a full rebuild
+  if(m_config.binned || !hasDrawSlots())
+    return false;
+
+  std::vector<DrawSlots> slots;
+  updateDrawItems(m_drawItems, objects, slots, stats);
+
+  // only the sequences of the modified objects are uploaded again, the preprocessing
+  // runs every frame and picks them up. The caller already waited for the gpu, so
+  // no barriers against previous frames are needed.
+  ResourcesVK* res = m_resources;
+  ScopeStaging staging(res->m_resourceAllocator, res->m_queue, res->m_queueFamily);
+
+  for(const DrawSlots& range : slots)
+  {
+    DrawSequence* sequences = staging.uploadT<DrawSequence>(m_draw.inputBuffer.buffer, sizeof(DrawSequence) * range.begin,
+                                                            sizeof(DrawSequence) * range.count);
+    uint32_t* combinedIndices = nullptr;
+    if(m_config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
+    {
+      combinedIndices = staging.uploadT<uint32_t>(m_draw.combinedIndices.buffer, sizeof(uint32_t) * range.begin,
+                                                  sizeof(uint32_t) * range.count);
+    }
+
+    for(uint32_t i = 0; i < range.count; i++)
+    {
+      fillSequence(sequences[i], &m_drawItems[range.begin + i], 1, range.begin + i, combinedIndices ? &combinedIndices[i] : nullptr);
+    }
+  }
+
+  return true;
 }
 
 VkGeneratedCommandsInfoEXT RendererVKGenEXT::getGeneratedCommandsInfo()
@@ -166,7 +166,8 @@ private:
     // setup staging buffer for filling
     ScopeStaging staging(res->m_resourceAllocator, res->m_queue, res->m_queueFamily);
 
-    m_draw.sequencesCount = drawCount;
+    size_t sequencesCount = getInstancedDrawCount(drawCount);
+    m_draw.sequencesCount = uint32_t(sequencesCount);
 
     // compute input buffer space requirements
     VkPhysicalDeviceProperties2 phyProps = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
@@ -178,7 +179,7 @@ private:
     // create input buffer
 
     size_t alignSeqIndexMask = genProps.minSequencesIndexBufferOffsetAlignment - 1;
-    size_t inputBufferSize   = ((sizeof(DrawSequence) * drawCount) + alignSeqIndexMask) & (~alignSeqIndexMask);
+    size_t inputBufferSize   = ((sizeof(DrawSequence) * sequencesCount) + alignSeqIndexMask) & (~alignSeqIndexMask);
     size_t seqindexOffset    = inputBufferSize;
 
     if(m_config.permutated)
@@ -207,20 +208,27 @@ private:
 
     // fill sequence
     DrawSequence* sequences = (DrawSequence*)inputMapping;
-    for(unsigned int i = 0; i < drawCount; i++)
+    for(unsigned int i = 0; i < sequencesCount; i++)
     {
-      const DrawItem&             di  = drawItems[i];
-      const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
+      DrawSlots       draw = getInstancedDraw(i);
+      const DrawItem& di   = drawItems[draw.begin];
+
+      int shaderIndex   = m_drawItemBits.getShaderIndex(di);
+      int geometryIndex = m_drawItemBits.getGeometryIndex(di);
+      int materialIndex = m_drawItemBits.getMaterialIndex(di);
+      int matrixIndex   = m_drawItemBits.getMatrixIndex(di);
+
+      const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
 
       DrawSequence& seq = sequences[i];
 
-      seq.shader.groupIndex = di.shaderIndex;
+      seq.shader.groupIndex = shaderIndex;
 
       seq.ibo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.ibo.buffer);
-      seq.ibo.indexType     = VK_INDEX_TYPE_UINT32;
+      seq.ibo.indexType     = geo.indexType;
 
       seq.vbo.bufferAddress = nvvk::getBufferDeviceAddress(res->m_device, geo.vbo.buffer);
-      seq.vbo.stride        = sizeof(CadScene::Vertex);
+      seq.vbo.stride        = scene.m_vertexSize;
 
 #if USE_DRAW_OFFSETS
       seq.ibo.size = scene.m_geometryMem.getChunk(geo.allocation).iboSize;
@@ -233,28 +241,32 @@ private:
       seq.vbo.size = geo.vbo.range;
 #endif
 
-      seq.pushMatrix   = matrixAddress + sizeof(CadScene::MatrixNode) * di.matrixIndex;
-      seq.pushMaterial = materialAddress + sizeof(CadScene::Material) * di.materialIndex;
+      seq.pushMatrix   = matrixAddress + sizeof(CadScene::MatrixNode) * matrixIndex;
+      seq.pushMaterial = materialAddress + sizeof(CadScene::Material) * materialIndex;
 
-      seq.drawIndexed.indexCount    = di.range.count;
-      seq.drawIndexed.instanceCount = 1;
+      seq.drawIndexed.indexCount    = di.count;
+      seq.drawIndexed.instanceCount = draw.count;
       seq.drawIndexed.firstInstance = 0;
-      seq.drawIndexed.firstIndex    = uint32_t(di.range.offset / sizeof(uint32_t));
+      seq.drawIndexed.firstIndex    = di.firstIndex;
       seq.drawIndexed.vertexOffset  = 0;
 #if USE_DRAW_OFFSETS
-      seq.drawIndexed.firstIndex += geo.ibo.offset / sizeof(uint32_t);
+      seq.drawIndexed.firstIndex += geo.ibo.offset / geo.indexSize;
 #endif
 #if USE_DRAW_OFFSETS
-      seq.drawIndexed.vertexOffset += geo.vbo.offset / sizeof(CadScene::Vertex);
+      seq.drawIndexed.vertexOffset += geo.vbo.offset / scene.m_vertexSize;
 #endif
       if(m_config.bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
       {
-        seq.drawIndexed.firstInstance = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        seq.drawIndexed.firstInstance = m_indexingBits.packIndices(matrixIndex, materialIndex);
       }
       else if(m_config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
       {
-        seq.drawIndexed.firstInstance = i;
-        combinedIndicesMapping[i]     = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        seq.drawIndexed.firstInstance = draw.begin;
+        for(uint32_t k = 0; k < draw.count; k++)
+        {
+          combinedIndicesMapping[draw.begin + k] =
+              m_indexingBits.packIndices(m_drawItemBits.getMatrixIndex(drawItems[draw.begin + k]), materialIndex);
+        }
       }
     }
 
@@ -282,7 +294,8 @@ private:
     // setup staging buffer for filling
     ScopeStaging staging(res->m_resourceAllocator, res->m_queue, res->m_queueFamily);
 
-    m_draw.sequencesCount = drawCount;
+    size_t sequencesCount = getInstancedDrawCount(drawCount);
+    m_draw.sequencesCount = uint32_t(sequencesCount);
 
     // compute input buffer
     VkPhysicalDeviceProperties2 phyProps = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
@@ -295,17 +308,17 @@ private:
 
     size_t totalSize  = 0;
     size_t pipeOffset = totalSize;
-    totalSize = totalSize + ((sizeof(VkBindShaderGroupIndirectCommandNV) * drawCount + alignMask) & (~alignMask));
+    totalSize = totalSize + ((sizeof(VkBindShaderGroupIndirectCommandNV) * sequencesCount + alignMask) & (~alignMask));
     size_t iboOffset = totalSize;
-    totalSize = totalSize + ((sizeof(VkBindIndexBufferIndirectCommandNV) * drawCount + alignMask) & (~alignMask));
+    totalSize = totalSize + ((sizeof(VkBindIndexBufferIndirectCommandNV) * sequencesCount + alignMask) & (~alignMask));
     size_t vboOffset = totalSize;
-    totalSize = totalSize + ((sizeof(VkBindVertexBufferIndirectCommandNV) * drawCount + alignMask) & (~alignMask));
+    totalSize = totalSize + ((sizeof(VkBindVertexBufferIndirectCommandNV) * sequencesCount + alignMask) & (~alignMask));
     size_t matrixOffset   = totalSize;
-    totalSize             = totalSize + ((sizeof(VkDeviceAddress) * drawCount + alignMask) & (~alignMask));
+    totalSize             = totalSize + ((sizeof(VkDeviceAddress) * sequencesCount + alignMask) & (~alignMask));
     size_t materialOffset = totalSize;
-    totalSize             = totalSize + ((sizeof(VkDeviceAddress) * drawCount + alignMask) & (~alignMask));
+    totalSize             = totalSize + ((sizeof(VkDeviceAddress) * sequencesCount + alignMask) & (~alignMask));
     size_t drawOffset     = totalSize;
-    totalSize             = totalSize + ((sizeof(VkDrawIndexedIndirectCommand) * drawCount + alignMask) & (~alignMask));
+    totalSize             = totalSize + ((sizeof(VkDrawIndexedIndirectCommand) * sequencesCount + alignMask) & (~alignMask));
     size_t seqindexOffset = totalSize;
 
     if(m_config.permutated)
@@ -339,20 +352,27 @@ private:
     VkDeviceAddress materialAddress = scene.m_buffers.materials.address;
 
     // let's record all token inputs for every drawcall
-    for(unsigned int i = 0; i < drawCount; i++)
+    for(unsigned int i = 0; i < sequencesCount; i++)
     {
-      const DrawItem&             di  = drawItems[i];
-      const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
+      DrawSlots       draw = getInstancedDraw(i);
+      const DrawItem& di   = drawItems[draw.begin];
+
+      int shaderIndex   = m_drawItemBits.getShaderIndex(di);
+      int geometryIndex = m_drawItemBits.getGeometryIndex(di);
+      int materialIndex = m_drawItemBits.getMaterialIndex(di);
+      int matrixIndex   = m_drawItemBits.getMatrixIndex(di);
+
+      const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
 
-      shaders[i].groupIndex = di.shaderIndex;
+      shaders[i].groupIndex = shaderIndex;
 
       VkBindIndexBufferIndirectCommandNV& ibo = ibos[i];
       ibo.bufferAddress                       = nvvk::getBufferDeviceAddress(res->m_device, geo.ibo.buffer);
-      ibo.indexType                           = VK_INDEX_TYPE_UINT32;
+      ibo.indexType                           = geo.indexType;
 
       VkBindVertexBufferIndirectCommandNV& vbo = vbos[i];
       vbo.bufferAddress                        = nvvk::getBufferDeviceAddress(res->m_device, geo.vbo.buffer);
-      vbo.stride                               = sizeof(CadScene::Vertex);
+      vbo.stride                               = scene.m_vertexSize;
 
 #if USE_DRAW_OFFSETS
       ibo.size = scene.m_geometryMem.getChunk(geo.allocation).iboSize;
@@ -365,29 +385,33 @@ private:
       vbo.size = geo.vbo.range;
 #endif
 
-      pushMatrices[i]  = matrixAddress + sizeof(CadScene::MatrixNode) * di.matrixIndex;
-      pushMaterials[i] = materialAddress + sizeof(CadScene::Material) * di.materialIndex;
+      pushMatrices[i]  = matrixAddress + sizeof(CadScene::MatrixNode) * matrixIndex;
+      pushMaterials[i] = materialAddress + sizeof(CadScene::Material) * materialIndex;
 
       VkDrawIndexedIndirectCommand& drawIndexed = draws[i];
-      drawIndexed.indexCount                    = di.range.count;
-      drawIndexed.instanceCount                 = 1;
-      drawIndexed.firstInstance                 = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
-      drawIndexed.firstIndex                    = uint32_t(di.range.offset / sizeof(uint32_t));
+      drawIndexed.indexCount                    = di.count;
+      drawIndexed.instanceCount                 = draw.count;
+      drawIndexed.firstInstance                 = m_indexingBits.packIndices(matrixIndex, materialIndex);
+      drawIndexed.firstIndex                    = di.firstIndex;
       drawIndexed.vertexOffset                  = 0;
 #if USE_DRAW_OFFSETS
-      drawIndexed.firstIndex += geo.ibo.offset / sizeof(uint32_t);
+      drawIndexed.firstIndex += geo.ibo.offset / geo.indexSize;
 #endif
 #if USE_DRAW_OFFSETS
-      drawIndexed.vertexOffset = geo.vbo.offset / sizeof(CadScene::Vertex);
+      drawIndexed.vertexOffset = geo.vbo.offset / scene.m_vertexSize;
 #endif
       if(m_config.bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
       {
-        drawIndexed.firstInstance = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        drawIndexed.firstInstance = m_indexingBits.packIndices(matrixIndex, materialIndex);
       }
       else if(m_config.bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
       {
-        drawIndexed.firstInstance = i;
-        combinedIndicesMapping[i] = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        drawIndexed.firstInstance = draw.begin;
+        for(uint32_t k = 0; k < draw.count; k++)
+        {
+          combinedIndicesMapping[draw.begin + k] =
+              m_indexingBits.packIndices(m_drawItemBits.getMatrixIndex(drawItems[draw.begin + k]), materialIndex);
+        }
       }
     }
     if(m_config.permutated)
@@ -21,7 +21,6 @@
 #include <algorithm>
 #include <assert.h>
 #include <mutex>
-#include <queue>
 
 #include "renderer.hpp"
 #include "resources_vk.hpp"
@@ -56,12 +55,21 @@ public:
       return renderer;
     }
     uint32_t priority() const override { return 10; }
+    // workers record fixed ranges of draw items
+    bool supportsInstancing() const override { return false; }
   };
 
 public:
   void init(const CadScene* scene, ResourcesVK* res, const Config& config, Stats& stats) override;
   void deinit() override;
   void draw(const Resources::Global& global, Stats& stats) override;
+  bool updateParts(const std::vector<uint32_t>& objects, Stats& stats) override
+  {
+    // command buffers are recorded from m_drawItems every frame
+    std::vector<DrawSlots> slots;
+    m_chunksWorkingSet = -1;
+    return updateDrawItems(m_drawItems, objects, slots, stats);
+  }
 
   RendererThreadedVK() {}
 
@@ -69,6 +77,7 @@ private:
   struct DrawSetup
   {
     std::vector<VkCommandBuffer> cmdbuffers;
+    double                       timeEnqueued;
   };
 
 
@@ -79,10 +88,11 @@ private:
 
     nvvk::RingCommandPool m_pool;
 
-    int                     m_frame;
-    std::condition_variable m_hasWorkCond;
-    std::mutex              m_hasWorkMutex;
-    volatile int            m_hasWork;
+    int              m_frame;
+    LatencyHistogram m_wakeLatency;
+
+    // chunks claimed since the last print, uneven counts across threads show imbalance
+    size_t m_claims;
 
     size_t                  m_scIdx;
     std::vector<DrawSetup*> m_scs;
@@ -128,19 +138,37 @@ private:
 
   ThreadJob* m_jobs;
 
-  volatile uint32_t m_ready;
-  volatile uint32_t m_stopThreads;
-  volatile size_t   m_numCurItems;
+  volatile uint32_t     m_ready;
+  std::atomic<uint32_t> m_stopThreads;
+
+  struct Chunk
+  {
+    size_t begin;
+    size_t num;
+  };
+
+  // rebuilt when the working set or the draw items change
+  std::vector<Chunk>  m_chunks;
+  int                 m_chunksWorkingSet;
+  std::atomic<size_t> m_chunkNext;
+
+  // workers run frame m_frameStarted once it matches their own frame
+  std::atomic<int> m_frameStarted;
+  double           m_frameStartTime;
+  SpinParkEvent    m_frameStartEvent;
 
   std::condition_variable m_readyCond;
   std::mutex              m_readyMutex;
 
   size_t                 m_numEnqueues;
-  std::queue<DrawSetup*> m_drawQueue;
+  // sized for a frame's entries, so workers never wait for space
+  MpscRing<DrawSetup*>  m_drawQueue;
+  std::atomic<uint32_t> m_drawQueued;
+  SpinParkEvent         m_drawQueuedEvent;
 
-  std::mutex              m_workMutex;
-  std::mutex              m_drawMutex;
-  std::condition_variable m_drawMutexCondition;
+  LatencyHistogram m_wakeLatency;
+  LatencyHistogram m_handoffLatency;
+  double           m_latencyBegin;
 
   VkCommandBuffer m_primary;
 
@@ -150,30 +178,67 @@ private:
     job->renderer->RunThread(job->index);
   }
 
-  bool getWork_ts(size_t& start, size_t& num)
+  bool getWork_ts(ThreadJob& job, size_t& start, size_t& num)
   {
-    std::lock_guard<std::mutex> lock(m_workMutex);
-    bool                        hasWork = false;
-
-    const size_t chunkSize = m_workingSet;
-    size_t       total     = m_drawItems.size();
+    size_t chunk = m_chunkNext.fetch_add(1, std::memory_order_relaxed);
 
-    if(m_numCurItems < total)
+    if(chunk < m_chunks.size())
     {
-      size_t batch = std::min(total - m_numCurItems, chunkSize);
-      start        = m_numCurItems;
-      num          = batch;
-      m_numCurItems += batch;
-      hasWork = true;
+      start = m_chunks[chunk].begin;
+      num   = m_chunks[chunk].num;
+      job.m_claims++;
+      return true;
     }
     else
     {
-      hasWork = false;
-      start   = 0;
-      num     = 0;
+      start = 0;
+      num   = 0;
+      return false;
+    }
+  }
+
+  bool isStateBoundary(size_t i) const
+  {
+    size_t   idxPrev = m_config.permutated ? m_seqIndices[i - 1] : i - 1;
+    size_t   idx     = m_config.permutated ? m_seqIndices[i] : i;
+    uint32_t shift   = m_drawItemBits.geometryShift;
+    // shader and geometry changes are the expensive state to re-establish in a new command buffer
+    return (m_drawItems[idxPrev].state >> shift) != (m_drawItems[idx].state >> shift);
+  }
+
+  // chunks of about workingSet draws, moved by up to a quarter to the nearest state boundary
+  void buildChunks(int workingSet)
+  {
+    size_t chunkSize = size_t(std::max(workingSet, 1));
+    size_t range     = chunkSize / 4;
+    size_t total     = m_drawItems.size();
+
+    m_chunks.clear();
+    for(size_t begin = 0; begin < total;)
+    {
+      size_t end = std::min(begin + chunkSize, total);
+      if(end < total)
+      {
+        for(size_t d = 0; d <= range; d++)
+        {
+          if(end + d < total && isStateBoundary(end + d))
+          {
+            end += d;
+            break;
+          }
+          if(isStateBoundary(end - d))
+          {
+            end -= d;
+            break;
+          }
+        }
+      }
+
+      m_chunks.push_back({begin, end - begin});
+      begin = end;
     }
 
-    return hasWork;
+    m_chunksWorkingSet = workingSet;
   }
 
   void         RunThread(int index);
@@ -193,6 +258,9 @@ private:
     int lastMatrix   = -1;
     int lastObject   = -1;
     int lastShader   = -1;
+#if USE_DRAW_OFFSETS
+    VkIndexType lastIndexType = VK_INDEX_TYPE_MAX_ENUM;
+#endif
 
     VkDeviceAddress matrixAddress   = scene.m_buffers.matrices.address;
     VkDeviceAddress materialAddress = scene.m_buffers.materials.address;
@@ -240,53 +308,65 @@ private:
       size_t          idx = m_config.permutated ? m_seqIndices[i + begin] : i + begin;
       const DrawItem& di  = drawItems[idx];
 
-      if(di.shaderIndex != lastShader)
+      // reserved slot of an inactive part
+      if(!di.count)
+        continue;
+
+      int shaderIndex   = m_drawItemBits.getShaderIndex(di);
+      int geometryIndex = m_drawItemBits.getGeometryIndex(di);
+      int materialIndex = m_drawItemBits.getMaterialIndex(di);
+      int matrixIndex   = m_drawItemBits.getMatrixIndex(di);
+
+      if(shaderIndex != lastShader)
       {
         if(m_config.shaderObjs)
         {
           VkShaderStageFlagBits stages[2]  = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_FRAGMENT_BIT};
-          VkShaderEXT           shaders[2] = {res->m_drawShading.vertexShaderObjs[di.shaderIndex],
-                                              res->m_drawShading.fragmentShaderObjs[di.shaderIndex]};
+          VkShaderEXT           shaders[2] = {res->m_drawShading.vertexShaderObjs[shaderIndex],
+                                              res->m_drawShading.fragmentShaderObjs[shaderIndex]};
           vkCmdBindShadersEXT(cmd, 2, stages, shaders);
         }
         else
         {
-          vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawShading.pipelines[di.shaderIndex]);
+          vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawShading.pipelines[shaderIndex]);
         }
 
-        lastShader = di.shaderIndex;
+        lastShader = shaderIndex;
       }
 
 #if USE_DRAW_OFFSETS
-      if(lastGeometry != int(scene.m_geometry[di.geometryIndex].allocation.chunkIndex))
+      // geometries within a chunk can use different index types
+      if(lastGeometry != int(scene.m_geometry[geometryIndex].allocation.chunkIndex)
+         || lastIndexType != scene.m_geometry[geometryIndex].indexType)
       {
-        const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
+        const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
 
-        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, 0, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, 0, geo.indexType);
         VkDeviceSize offset = {0};
         VkDeviceSize size   = {VK_WHOLE_SIZE};
-        VkDeviceSize stride = {sizeof(CadScene::Vertex)};
+        VkDeviceSize stride = {scene.m_vertexSize};
 #if USE_DYNAMIC_VERTEX_STRIDE
         vkCmdBindVertexBuffers2(cmd, 0, 1, &geo.vbo.buffer, &offset, &size, &stride);
 #else
         vkCmdBindVertexBuffers(cmd, 0, 1, &geo.vbo.buffer, &offset);
 #endif
-        lastGeometry = int(scene.m_geometry[di.geometryIndex].allocation.chunkIndex);
+        lastGeometry  = int(scene.m_geometry[geometryIndex].allocation.chunkIndex);
+        lastIndexType = geo.indexType;
       }
 #else
-      if(lastGeometry != di.geometryIndex)
+      if(lastGeometry != geometryIndex)
       {
-        const CadSceneVK::Geometry& geo    = scene.m_geometry[di.geometryIndex];
-        VkDeviceSize                stride = {sizeof(CadScene::Vertex)};
+        const CadSceneVK::Geometry& geo    = scene.m_geometry[geometryIndex];
+        VkDeviceSize                stride = {scene.m_vertexSize};
 
-        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, geo.ibo.offset, VK_INDEX_TYPE_UINT32);
+        vkCmdBindIndexBuffer(cmd, geo.ibo.buffer, geo.ibo.offset, geo.indexType);
 #if USE_DYNAMIC_VERTEX_STRIDE
         vkCmdBindVertexBuffers2(cmd, 0, 1, &geo.vbo.buffer, &geo.vbo.offset, &geo.vbo.range, &stride);
 #else
         vkCmdBindVertexBuffers(cmd, 0, 1, &geo.vbo.buffer, &geo.vbo.offset);
 #endif
 
-        lastGeometry = di.geometryIndex;
+        lastGeometry = geometryIndex;
       }
 #endif
 
@@ -294,63 +374,63 @@ private:
 
       if(bindingMode == BINDINGMODE_DSETS)
       {
-        if(lastMatrix != di.matrixIndex)
+        if(lastMatrix != matrixIndex)
         {
-          uint32_t offset = di.matrixIndex * res->m_alignedMatrixSize;
+          uint32_t offset = matrixIndex * res->m_alignedMatrixSize;
           vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawBind.getPipeLayout(),
                                   DRAW_UBO_MATRIX, 1, res->m_drawBind.at(DRAW_UBO_MATRIX).getSets(), 1, &offset);
-          lastMatrix = di.matrixIndex;
+          lastMatrix = matrixIndex;
         }
 
-        if(lastMaterial != di.materialIndex)
+        if(lastMaterial != materialIndex)
         {
-          uint32_t offset = di.materialIndex * res->m_alignedMaterialSize;
+          uint32_t offset = materialIndex * res->m_alignedMaterialSize;
           vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, res->m_drawBind.getPipeLayout(),
                                   DRAW_UBO_MATERIAL, 1, res->m_drawBind.at(DRAW_UBO_MATERIAL).getSets(), 1, &offset);
-          lastMaterial = di.materialIndex;
+          lastMaterial = materialIndex;
         }
       }
       else if(bindingMode == BINDINGMODE_PUSHADDRESS)
       {
-        if(lastMatrix != di.matrixIndex)
+        if(lastMatrix != matrixIndex)
         {
-          VkDeviceAddress address = matrixAddress + sizeof(CadScene::MatrixNode) * di.matrixIndex;
+          VkDeviceAddress address = matrixAddress + sizeof(CadScene::MatrixNode) * matrixIndex;
 
           vkCmdPushConstants(cmd, res->m_drawPush.getPipeLayout(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(VkDeviceAddress), &address);
 
-          lastMatrix = di.matrixIndex;
+          lastMatrix = matrixIndex;
         }
 
-        if(lastMaterial != di.materialIndex)
+        if(lastMaterial != materialIndex)
         {
-          VkDeviceAddress address = materialAddress + sizeof(CadScene::Material) * di.materialIndex;
+          VkDeviceAddress address = materialAddress + sizeof(CadScene::Material) * materialIndex;
 
           vkCmdPushConstants(cmd, res->m_drawPush.getPipeLayout(), VK_SHADER_STAGE_FRAGMENT_BIT,
                              sizeof(VkDeviceAddress), sizeof(VkDeviceAddress), &address);
 
-          lastMaterial = di.materialIndex;
+          lastMaterial = materialIndex;
         }
       }
       else if(bindingMode == BINDINGMODE_INDEX_BASEINSTANCE)
       {
-        firstInstance = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        firstInstance = m_indexingBits.packIndices(matrixIndex, materialIndex);
       }
       else if(bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
       {
         firstInstance                    = i;
-        m_combinedIndicesData[begin + i] = m_indexingBits.packIndices(di.matrixIndex, di.materialIndex);
+        m_combinedIndicesData[begin + i] = m_indexingBits.packIndices(matrixIndex, materialIndex);
       }
 
       // drawcall
 #if USE_DRAW_OFFSETS
-      const CadSceneVK::Geometry& geo = scene.m_geometry[di.geometryIndex];
-      vkCmdDrawIndexed(cmd, di.range.count, 1, uint32_t(di.range.offset + geo.ibo.offset / sizeof(uint32_t)),
-                       geo.vbo.offset / sizeof(CadScene::Vertex), firstInstance);
+      const CadSceneVK::Geometry& geo = scene.m_geometry[geometryIndex];
+      vkCmdDrawIndexed(cmd, di.count, 1, di.firstIndex + uint32_t(geo.ibo.offset / geo.indexSize),
+                       geo.vbo.offset / scene.m_vertexSize, firstInstance);
 #else
-      vkCmdDrawIndexed(cmd, di.range.count, 1, uint32_t(di.range.offset / sizeof(uint32_t)), 0, firstInstance);
+      vkCmdDrawIndexed(cmd, di.count, 1, di.firstIndex, 0, firstInstance);
 #endif
 
-      lastShader = di.shaderIndex;
+      lastShader = shaderIndex;
     }
 
     if(m_combinedIndicesData.size())
@@ -421,17 +501,25 @@ void RendererThreadedVK::init(const CadScene* scene, ResourcesVK* resources, con
   m_threadpool.init(m_config.workerThreads);
 
   // make jobs
-  m_ready       = 0;
-  m_jobs        = new ThreadJob[m_config.workerThreads];
-  m_stopThreads = 0;
+  m_ready        = 0;
+  m_jobs         = new ThreadJob[m_config.workerThreads];
+  m_stopThreads  = 0;
+  m_frameStarted = -1;
+  m_drawQueued   = 0;
+  m_latencyBegin = NVPSystem::getTime();
+  m_frameStartEvent.setSpinning(config.workerSpin);
+  m_drawQueuedEvent.setSpinning(config.workerSpin);
+
+  // built by the first frame
+  m_chunksWorkingSet = -1;
 
   for(uint32_t i = 0; i < m_config.workerThreads; i++)
   {
     ThreadJob& job = m_jobs[i];
     job.index      = i;
     job.renderer   = this;
-    job.m_hasWork  = -1;
     job.m_frame    = 0;
+    job.m_claims   = 0;
 
     job.m_pool.init(res->m_device, res->m_context->m_queueGCT);
 
@@ -447,13 +535,7 @@ void RendererThreadedVK::deinit()
   m_ready       = 0;
 
   THREAD_BARRIER();
-  for(uint32_t i = 0; i < m_config.workerThreads; i++)
-  {
-    std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-    m_jobs[i].m_hasWork = m_frame;
-    m_jobs[i].m_hasWorkCond.notify_one();
-  }
-  m_drawMutexCondition.notify_all();
+  m_frameStartEvent.notify();
 
   std::this_thread::yield();
 
@@ -495,10 +577,15 @@ void RendererThreadedVK::deinit()
 
 void RendererThreadedVK::enqueueShadeCommand_ts(DrawSetup* sc)
 {
-  std::unique_lock<std::mutex> lock(m_drawMutex);
+  if(sc)
+  {
+    sc->timeEnqueued = NVPSystem::getTime();
+  }
 
   m_drawQueue.push(sc);
-  m_drawMutexCondition.notify_one();
+
+  m_drawQueued.fetch_add(1);
+  m_drawQueuedEvent.notify();
 }
 
 unsigned int RendererThreadedVK::RunThreadFrame(ThreadJob& job)
@@ -518,7 +605,7 @@ unsigned int RendererThreadedVK::RunThreadFrame(ThreadJob& job)
   if(m_workerBatched || true)
   {
     DrawSetup* sc = job.getFrameCommand();
-    while(getWork_ts(begin, num))
+    while(getWork_ts(job, begin, num))
     {
       setupCmdBuffer(*sc, job.m_pool, begin, m_drawItems.data(), num);
       tnum += num;
@@ -531,7 +618,7 @@ unsigned int RendererThreadedVK::RunThreadFrame(ThreadJob& job)
   }
   else
   {
-    while(getWork_ts(begin, num))
+    while(getWork_ts(job, begin, num))
     {
       DrawSetup* sc = job.getFrameCommand();
       setupCmdBuffer(*sc, job.m_pool, begin, m_drawItems.data(), num);
@@ -566,19 +653,15 @@ void RendererThreadedVK::RunThread(int tid)
   {
     double beginFrame = NVPSystem::getTime();
     timeFrame -= NVPSystem::getTime();
-    {
-      std::unique_lock<std::mutex> lock(job.m_hasWorkMutex);
-      while(job.m_hasWork != job.m_frame)
-      {
-        job.m_hasWorkCond.wait(lock);
-      }
-    }
+    m_frameStartEvent.wait([&]() { return m_frameStarted.load() == job.m_frame || m_stopThreads.load(); });
 
     if(m_stopThreads)
     {
       break;
     }
 
+    job.m_wakeLatency.add((NVPSystem::getTime() - m_frameStartTime) * 1000000.0);
+
     double beginWork = NVPSystem::getTime();
     timeWork -= NVPSystem::getTime();
 
@@ -604,10 +687,14 @@ void RendererThreadedVK::RunThread(int tid)
       timePrint = currentTime;
 
       float avgdispatch = float(double(dispatches) / double(timerFrames));
+      float avgclaims   = float(double(job.m_claims) / double(timerFrames));
 
 #if 1
-      LOGI("thread %d: work %6d [us] cmdbuffers %5.1f (avg)\n", tid, uint32_t(timeWork), avgdispatch);
+      LOGI("thread %d: work %6d [us] cmdbuffers %5.1f chunks %6.1f (avg)\n", tid, uint32_t(timeWork), avgdispatch,
+           avgclaims);
 #endif
+      job.m_claims = 0;
+
       timeFrame = 0;
       timeWork  = 0;
 
@@ -630,71 +717,90 @@ void RendererThreadedVK::drawThreaded(const Resources::Global& global, VkCommand
 
   m_workingSet    = global.workingSet;
   m_workerBatched = global.workerBatched;
-  m_numCurItems   = 0;
+  m_chunkNext     = 0;
   m_numEnqueues   = 0;
   m_cycleCurrent  = res->m_ringFences.getCycleIndex();
 
   stats.cmdBuffers = 0;
 
+  if(m_chunksWorkingSet != m_workingSet)
+  {
+    buildChunks(m_workingSet);
+
+    // one entry per chunk at most, plus the nullptr of each worker
+    size_t queueSize = m_chunks.size() + m_config.workerThreads;
+    if(m_drawQueue.getCapacity() < queueSize)
+    {
+      m_drawQueue.init(queueSize);
+    }
+  }
+
   // generate & cmdbuffers in parallel
 
   THREAD_BARRIER();
 
   // start to dispatch threads
-  for(uint32_t i = 0; i < m_config.workerThreads; i++)
-  {
-    {
-      std::unique_lock<std::mutex> lock(m_jobs[i].m_hasWorkMutex);
-      m_jobs[i].m_hasWork = m_frame;
-    }
-    m_jobs[i].m_hasWorkCond.notify_one();
-  }
+  m_frameStartTime = NVPSystem::getTime();
+  m_frameStarted.store(m_frame);
+  m_frameStartEvent.notify();
 
   // collect secondaries here
   {
-    int numTerminated = 0;
+    uint32_t numDequeued   = 0;
+    int      numTerminated = 0;
     while(true)
     {
-      bool       hadEntry = false;
-      DrawSetup* sc       = nullptr;
-      {
-        std::unique_lock<std::mutex> lock(m_drawMutex);
-        if(m_drawQueue.empty())
-        {
-          m_drawMutexCondition.wait(lock);
-        }
-        if(!m_drawQueue.empty())
-        {
+      m_drawQueuedEvent.wait([&]() { return m_drawQueued.load() != numDequeued; });
 
-          sc = m_drawQueue.front();
-          m_drawQueue.pop();
+      // a push completed, but an older slot may not be written yet, pop waits for it
+      DrawSetup* sc = nullptr;
+      m_drawQueue.pop(sc);
+      numDequeued++;
 
-          hadEntry = true;
-        }
+      if(sc)
+      {
+        m_handoffLatency.add((NVPSystem::getTime() - sc->timeEnqueued) * 1000000.0);
+        m_numEnqueues++;
+        THREAD_BARRIER();
+        vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
+        stats.cmdBuffers += (uint32_t)sc->cmdbuffers.size();
+        sc->cmdbuffers.clear();
       }
-
-      if(hadEntry)
+      else
       {
-        if(sc)
-        {
-          m_numEnqueues++;
-          THREAD_BARRIER();
-          vkCmdExecuteCommands(primary, (uint32_t)sc->cmdbuffers.size(), sc->cmdbuffers.data());
-          stats.cmdBuffers += (uint32_t)sc->cmdbuffers.size();
-          sc->cmdbuffers.clear();
-        }
-        else
-        {
-          numTerminated++;
-        }
+        numTerminated++;
       }
 
       if(numTerminated == m_config.workerThreads)
       {
         break;
       }
-      std::this_thread::yield();
     }
+    m_drawQueued.fetch_sub(numDequeued);
+  }
+
+  // workers are done with the frame, their histograms are safe to read
+  for(uint32_t i = 0; i < m_config.workerThreads; i++)
+  {
+    m_wakeLatency.add(m_jobs[i].m_wakeLatency);
+    m_jobs[i].m_wakeLatency = LatencyHistogram();
+  }
+
+  double currentTime = NVPSystem::getTime();
+  if(currentTime - m_latencyBegin > 2.0)
+  {
+    stats.wakeLatency    = m_wakeLatency;
+    stats.handoffLatency = m_handoffLatency;
+    m_wakeLatency        = LatencyHistogram();
+    m_handoffLatency     = LatencyHistogram();
+    m_latencyBegin       = currentTime;
+
+#if PRINT_TIMER_STATS
+    LOGI("wake latency    p50 %6.2f p99 %6.2f [us]\n", stats.wakeLatency.getPercentile(0.5),
+         stats.wakeLatency.getPercentile(0.99));
+    LOGI("handoff latency p50 %6.2f p99 %6.2f [us]\n", stats.handoffLatency.getPercentile(0.5),
+         stats.handoffLatency.getPercentile(0.99));
+#endif
   }
 
   m_frame++;
@@ -260,6 +260,7 @@ bool ResourcesVK::init(nvvk::Context* context, nvvk::SwapChain* swapChain, nvh::
     m_anim.addBinding(ANIM_UBO, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0);
     m_anim.addBinding(ANIM_SSBO_MATRIXOUT, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0);
     m_anim.addBinding(ANIM_SSBO_MATRIXORIG, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+    m_anim.addBinding(ANIM_SSBO_MATRIXNODE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0);
     m_anim.initLayout();
     m_anim.initPipeLayout();
     m_anim.initPool(1);
@@ -711,9 +712,10 @@ void ResourcesVK::initPipelinesOrShaders(BindingMode bindingMode, VkPipelineCrea
   m_gfxState.addDynamicStateEnable(VK_DYNAMIC_STATE_VERTEX_INPUT_BINDING_STRIDE);
 #endif
 
-  m_gfxState.addAttributeDescription(
-      nvvk::GraphicsPipelineState::makeVertexInputAttribute(VERTEX_POS_OCTNORMAL, 0, VK_FORMAT_R32G32B32A32_SFLOAT, 0));
-  m_gfxState.addBindingDescription(nvvk::GraphicsPipelineState::makeVertexInputBinding(0, sizeof(CadScene::Vertex)));
+  // must match VERTEX_QUANTIZED in the shader prepend
+  VkFormat vertexFormat = m_scene.m_quantizedVertices ? VK_FORMAT_R16G16B16A16_UINT : VK_FORMAT_R32G32B32A32_SFLOAT;
+  m_gfxState.addAttributeDescription(nvvk::GraphicsPipelineState::makeVertexInputAttribute(VERTEX_POS_OCTNORMAL, 0, vertexFormat, 0));
+  m_gfxState.addBindingDescription(nvvk::GraphicsPipelineState::makeVertexInputBinding(0, m_scene.m_vertexSize));
 
   if(bindingMode == BINDINGMODE_INDEX_VERTEXATTRIB)
   {
@@ -1037,7 +1039,7 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
 {
   VkResult result = VK_SUCCESS;
 
-  m_numMatrices = uint(cadscene.m_matrices.size());
+  m_numMatrices = uint(cadscene.getNumMatrices());
 
   CadSceneVK::Config cfg;
 #if USE_SINGLE_GEOMETRY_ALLOCATION
@@ -1077,6 +1079,7 @@ bool ResourcesVK::initScene(const CadScene& cadscene)
     updateDescriptors.push_back(m_anim.makeWrite(0, ANIM_UBO, &m_common.animInfo));
     updateDescriptors.push_back(m_anim.makeWrite(0, ANIM_SSBO_MATRIXOUT, &m_scene.m_infos.matrices));
     updateDescriptors.push_back(m_anim.makeWrite(0, ANIM_SSBO_MATRIXORIG, &m_scene.m_infos.matricesOrig));
+    updateDescriptors.push_back(m_anim.makeWrite(0, ANIM_SSBO_MATRIXNODE, &m_scene.m_infos.animationNodes));
 
     vkUpdateDescriptorSets(m_device, updateDescriptors.size(), updateDescriptors.data(), 0, 0);
   }
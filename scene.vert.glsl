@@ -70,7 +70,12 @@
 #endif
 
 
+#if VERTEX_QUANTIZED
+// unorm16 position relative to the geometry bbox, which the matrix takes care of, snorm8 oct normal
+in layout(location=VERTEX_POS_OCTNORMAL)       uvec4 inPosNormal;
+#else
 in layout(location=VERTEX_POS_OCTNORMAL)       vec4 inPosNormal;
+#endif
 
 layout(location=0) out Interpolants {
   vec3 wPos;
@@ -101,9 +106,15 @@ vec2 float32x3_to_oct(in vec3 v) {
 
 void main()
 {
+#if VERTEX_QUANTIZED
+  vec3 inNormal = oct_to_float32x3(unpackSnorm4x8(inPosNormal.w).xy);
+  vec3 inPos    = vec3(inPosNormal.xyz);
+#else
   vec3 inNormal = oct_to_float32x3(unpackSnorm2x16(floatBitsToUint(inPosNormal.w)));
+  vec3 inPos    = inPosNormal.xyz;
+#endif
 
-  vec3 wPos     = (matrix.worldMatrix   * vec4(inPosNormal.xyz,1)).xyz;
+  vec3 wPos     = (matrix.worldMatrix   * vec4(inPos,1)).xyz;
   vec3 wNormal  = mat3(matrix.worldMatrixIT) * inNormal;
 
   gl_Position   = scene.viewProjMatrix * vec4(wPos,1);
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "taskscheduler.hpp"
+#include "threadpool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+namespace {
+struct CurrentWorker
+{
+  const TaskScheduler* scheduler = nullptr;
+  int                  index     = -1;
+};
+
+thread_local CurrentWorker s_currentWorker;
+
+uint64_t getTimeNs()
+{
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+}  // namespace
+
+TaskScheduler& TaskScheduler::getGlobal()
+{
+  static TaskScheduler s_global;
+  return s_global;
+}
+
+void TaskScheduler::init(unsigned int numWorkers)
+{
+  deinit();
+
+  m_stop       = false;
+  m_statsBegin = getTimeNs();
+  m_workers.resize(numWorkers);
+  for(unsigned int i = 0; i < numWorkers; i++)
+  {
+    m_workers[i].reset(new Worker);
+    m_workers[i]->placementSlot = ThreadPool::sysAcquirePlacementSlot();
+  }
+  // all deques exist before any worker can steal
+  for(unsigned int i = 0; i < numWorkers; i++)
+  {
+    m_workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+  }
+}
+
+void TaskScheduler::deinit()
+{
+  if(m_workers.empty())
+    return;
+
+  {
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_stop = true;
+    m_sleepCond.notify_all();
+  }
+
+  for(auto& worker : m_workers)
+  {
+    worker->thread.join();
+    ThreadPool::sysReleasePlacementSlot(worker->placementSlot);
+  }
+  m_workers.clear();
+
+  assert(m_shared.empty() && m_numQueued == 0);
+}
+
+int TaskScheduler::getWorkerIndex() const
+{
+  return s_currentWorker.scheduler == this ? s_currentWorker.index : -1;
+}
+
+void TaskScheduler::spawn(TaskGroup& group, Task task)
+{
+  if(m_workers.empty())
+  {
+    task();
+    return;
+  }
+
+  group.m_pending.fetch_add(1, std::memory_order_relaxed);
+
+  int workerIndex = getWorkerIndex();
+  if(workerIndex >= 0)
+  {
+    Worker&                     worker = *m_workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    worker.deque.push_back({std::move(task), &group});
+  }
+  else
+  {
+    std::lock_guard<std::mutex> lock(m_sharedMutex);
+    m_shared.push_back({std::move(task), &group});
+  }
+
+  // pairs with the re-check in workerLoop, a worker either sees the task or gets woken up
+  m_numQueued.fetch_add(1);
+  if(m_numSleeping.load())
+  {
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_sleepCond.notify_one();
+  }
+}
+
+bool TaskScheduler::findTask(int workerIndex, Entry& entry, bool& stolen)
+{
+  if(!m_numQueued.load(std::memory_order_relaxed))
+    return false;
+
+  // own tasks newest first, they are most likely still in cache
+  if(workerIndex >= 0)
+  {
+    Worker&                     worker = *m_workers[workerIndex];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if(!worker.deque.empty())
+    {
+      entry = std::move(worker.deque.back());
+      worker.deque.pop_back();
+      m_numQueued.fetch_sub(1);
+      stolen = false;
+      return true;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(m_sharedMutex);
+    if(!m_shared.empty())
+    {
+      entry = std::move(m_shared.front());
+      m_shared.pop_front();
+      m_numQueued.fetch_sub(1);
+      stolen = true;
+      return true;
+    }
+  }
+
+  // steal the oldest tasks, starting with the next worker
+  size_t numWorkers = m_workers.size();
+  for(size_t v = 1; v <= numWorkers; v++)
+  {
+    size_t victim = (size_t(workerIndex + 1) + v - 1) % numWorkers;
+    if(int(victim) == workerIndex)
+      continue;
+
+    Worker&                     worker = *m_workers[victim];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if(!worker.deque.empty())
+    {
+      entry = std::move(worker.deque.front());
+      worker.deque.pop_front();
+      m_numQueued.fetch_sub(1);
+      stolen = true;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void TaskScheduler::execute(int workerIndex, Entry& entry, bool stolen)
+{
+  if(workerIndex >= 0)
+  {
+    Worker& worker = *m_workers[workerIndex];
+    worker.tasks.fetch_add(1, std::memory_order_relaxed);
+    worker.steals.fetch_add(stolen ? 1 : 0, std::memory_order_relaxed);
+  }
+
+  entry.task();
+  entry.group->m_pending.fetch_sub(1, std::memory_order_release);
+}
+
+void TaskScheduler::wait(TaskGroup& group)
+{
+  int workerIndex = getWorkerIndex();
+
+  while(!group.isDone())
+  {
+    Entry entry;
+    bool  stolen;
+    if(findTask(workerIndex, entry, stolen))
+    {
+      // time of a waiting worker is accounted by the task it runs in
+      execute(workerIndex, entry, stolen);
+    }
+    else
+    {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void TaskScheduler::workerLoop(unsigned int index)
+{
+  s_currentWorker.scheduler = this;
+  s_currentWorker.index     = int(index);
+
+  ThreadPool::sysPinWorkerThread(m_workers[index]->placementSlot);
+
+  Worker&  worker   = *m_workers[index];
+  uint64_t timeLast = getTimeNs();
+
+  while(true)
+  {
+    Entry entry;
+    bool  stolen;
+    if(findTask(int(index), entry, stolen))
+    {
+      // stats may have been reset meanwhile
+      uint64_t timeBegin = getTimeNs();
+      timeLast           = std::max(timeLast, m_statsBegin.load(std::memory_order_relaxed));
+      worker.nsIdle.fetch_add(timeBegin - std::min(timeLast, timeBegin), std::memory_order_relaxed);
+
+      execute(int(index), entry, stolen);
+
+      timeLast = getTimeNs();
+      worker.nsBusy.fetch_add(timeLast - timeBegin, std::memory_order_relaxed);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    if(m_stop)
+      break;
+
+    m_numSleeping.fetch_add(1);
+    if(!m_numQueued.load())
+    {
+      m_sleepCond.wait(lock);
+    }
+    m_numSleeping.fetch_sub(1);
+  }
+
+  uint64_t timeEnd = getTimeNs();
+  timeLast         = std::max(timeLast, m_statsBegin.load(std::memory_order_relaxed));
+  worker.nsIdle.fetch_add(timeEnd - std::min(timeLast, timeEnd), std::memory_order_relaxed);
+}
+
+void TaskScheduler::getStats(std::vector<WorkerStats>& stats) const
+{
+  stats.resize(m_workers.size());
+  for(size_t i = 0; i < m_workers.size(); i++)
+  {
+    const Worker& worker = *m_workers[i];
+    stats[i].tasks       = worker.tasks.load(std::memory_order_relaxed);
+    stats[i].steals      = worker.steals.load(std::memory_order_relaxed);
+    stats[i].timeBusy    = double(worker.nsBusy.load(std::memory_order_relaxed)) / 1000000.0;
+    stats[i].timeIdle    = double(worker.nsIdle.load(std::memory_order_relaxed)) / 1000000.0;
+  }
+}
+
+void TaskScheduler::resetStats()
+{
+  m_statsBegin = getTimeNs();
+  for(auto& worker : m_workers)
+  {
+    worker->tasks  = 0;
+    worker->steals = 0;
+    worker->nsBusy = 0;
+    worker->nsIdle = 0;
+  }
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef TASKSCHEDULER_H__
+#define TASKSCHEDULER_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing task scheduler. Every worker owns a deque, it runs its own tasks
+// newest first and steals the oldest tasks of other workers when it runs dry.
+// Tasks spawned by other threads go to a shared queue. Threads that wait on a
+// TaskGroup execute pending tasks meanwhile, so parallel work can be nested.
+class TaskScheduler
+{
+public:
+  typedef std::function<void()> Task;
+
+  class TaskGroup
+  {
+  public:
+    bool isDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class TaskScheduler;
+    std::atomic<size_t> m_pending{0};
+  };
+
+  struct WorkerStats
+  {
+    uint64_t tasks    = 0;  // executed
+    uint64_t steals   = 0;  // of those taken from other workers or the shared queue
+    double   timeBusy = 0;  // ms in tasks
+    double   timeIdle = 0;  // ms searching for tasks or parked
+  };
+
+  ~TaskScheduler() { deinit(); }
+
+  void init(unsigned int numWorkers);
+  void deinit();
+
+  bool         isInitialized() const { return !m_workers.empty(); }
+  unsigned int getNumWorkers() const { return unsigned(m_workers.size()); }
+
+  // runs the task inline if there are no workers
+  void spawn(TaskGroup& group, Task task);
+  // executes pending tasks until all tasks of the group finished
+  void wait(TaskGroup& group);
+
+  // runs fn(begin, end) over [0, numItems) in batches of batchSize on at most maxConcurrency
+  // threads, the calling thread participates. Batches are handed out dynamically.
+  template <class F>
+  void parallelFor(size_t numItems, size_t batchSize, unsigned int maxConcurrency, F&& fn);
+
+  // per worker since init or resetStats
+  void getStats(std::vector<WorkerStats>& stats) const;
+  void resetStats();
+
+  // shared by scene loading and draw list building through ThreadPool::parallelBatches
+  static TaskScheduler& getGlobal();
+
+private:
+  struct Entry
+  {
+    Task       task;
+    TaskGroup* group;
+  };
+
+  struct Worker
+  {
+    std::mutex        mutex;
+    std::deque<Entry> deque;
+    std::thread       thread;
+    unsigned int      placementSlot;
+
+    std::atomic<uint64_t> tasks{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> nsBusy{0};
+    std::atomic<uint64_t> nsIdle{0};
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+
+  std::mutex        m_sharedMutex;
+  std::deque<Entry> m_shared;
+
+  // queued in all deques, parking workers re-check it under m_sleepMutex
+  std::atomic<size_t>     m_numQueued{0};
+  std::atomic<uint32_t>   m_numSleeping{0};
+  std::mutex              m_sleepMutex;
+  std::condition_variable m_sleepCond;
+  bool                    m_stop = false;
+  std::atomic<uint64_t>   m_statsBegin{0};
+
+  // index of the calling thread's worker, or -1
+  int getWorkerIndex() const;
+
+  bool findTask(int workerIndex, Entry& entry, bool& stolen);
+  void execute(int workerIndex, Entry& entry, bool stolen);
+  void workerLoop(unsigned int index);
+};
+
+template <class F>
+void TaskScheduler::parallelFor(size_t numItems, size_t batchSize, unsigned int maxConcurrency, F&& fn)
+{
+  batchSize         = std::max(batchSize, size_t(1));
+  size_t numBatches = (numItems + batchSize - 1) / batchSize;
+  size_t numTasks   = std::min(std::min(size_t(maxConcurrency), size_t(getNumWorkers()) + 1), numBatches);
+
+  if(numTasks <= 1)
+  {
+    if(numItems)
+    {
+      fn(size_t(0), numItems);
+    }
+    return;
+  }
+
+  std::atomic<size_t> counter(0);
+
+  auto runBatches = [&]() {
+    while(true)
+    {
+      size_t begin = counter.fetch_add(batchSize);
+      if(begin >= numItems)
+        break;
+
+      fn(begin, std::min(begin + batchSize, numItems));
+    }
+  };
+
+  TaskGroup group;
+  for(size_t t = 1; t < numTasks; t++)
+  {
+    spawn(group, runBatches);
+  }
+  runBatches();
+  wait(group);
+}
+
+#endif
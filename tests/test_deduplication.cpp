@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// CadScene::deduplicateGeometry on synthetic geometries: with quantized vertices, meshes with
+// identical vertex bytes but different bboxes are different meshes and must not be merged.
+
+#include "cadscene.hpp"
+#include <nvh/nvprint.hpp>
+
+#include <cstdlib>
+
+int main(int argc, char** argv)
+{
+  // the same quantized triangle within three bboxes, the second has twice the size
+  static const CadScene::VertexQuantized vertices[3] = {
+      {{0, 0, 0}, 0, 0},
+      {{65535, 0, 0}, 0, 0},
+      {{0, 65535, 65535}, 0, 0},
+  };
+  static const uint32_t indices[3] = {0, 1, 2};
+
+  CadScene::GeometryPart part;
+  part.indexSolid.count = 3;
+
+  const float scales[3] = {1.0f, 2.0f, 1.0f};
+
+  bool passed = true;
+  for(int quantized = 0; quantized < 2; quantized++)
+  {
+    CadScene scene;
+    scene.m_quantizedVertices = quantized != 0;
+    for(int g = 0; g < 3; g++)
+    {
+      CadScene::Geometry geom;
+      geom.cloneIdx      = -1;
+      geom.vboSize       = sizeof(vertices);
+      geom.iboSize       = sizeof(indices);
+      geom.vboData       = (void*)vertices;
+      geom.iboData       = (void*)indices;
+      geom.vboOwned      = false;
+      geom.iboOwned      = false;
+      geom.parts         = &part;
+      geom.numParts      = 1;
+      geom.numVertices   = 3;
+      geom.numIndexSolid = 3;
+      geom.numIndexWire  = 0;
+      scene.m_geometry.push_back(geom);
+
+      CadScene::BBox bbox;
+      bbox.merge(glm::vec4(0, 0, 0, 1));
+      bbox.merge(glm::vec4(scales[g], scales[g], scales[g], 1));
+      scene.m_geometryBboxes.push_back(bbox);
+    }
+
+    std::vector<int> remap;
+    scene.deduplicateGeometry(1, remap);
+
+    // unquantized the vertex bytes are the positions, so equal bytes mean equal meshes
+    bool expected = quantized ? (remap[0] == 0 && remap[1] == 1 && remap[2] == 0 && scene.m_geometry.size() == 2
+                                 && scene.m_geometryBboxes[1].max.x == 2.0f) :
+                                (remap[0] == 0 && remap[1] == 0 && remap[2] == 0 && scene.m_geometry.size() == 1);
+
+    LOGI("deduplication test: quantized %d, remap %d %d %d: %s\n", quantized, remap[0], remap[1], remap[2],
+         expected ? "passed" : "FAILED");
+    passed = passed && expected;
+
+    // nothing was allocated from the arena
+    scene.m_geometry.clear();
+  }
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
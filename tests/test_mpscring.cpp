@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+// Stress test of MpscRing with the producer/consumer handshake of the threaded renderer,
+// checks that every item arrives once and in order per producer.
+// usage: test_mpscring [producers] [items per producer]
+
+#include "threadpool.hpp"
+#include <nvh/nvprint.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+  uint32_t numProducers = argc > 1 ? uint32_t(atoi(argv[1])) : 8;
+  uint32_t numItems     = argc > 2 ? uint32_t(atoi(argv[2])) : 100000;
+
+  // small ring, so producers also run into a full ring
+  MpscRing<uint64_t> ring;
+  ring.init(std::max(numProducers, 1u) * 2);
+
+  std::atomic<uint32_t> queued(0);
+  SpinParkEvent         queuedEvent;
+
+  std::vector<std::thread> producers(numProducers);
+  for(uint32_t p = 0; p < numProducers; p++)
+  {
+    producers[p] = std::thread([&, p]() {
+      for(uint32_t i = 0; i < numItems; i++)
+      {
+        ring.push((uint64_t(p) << 32) | i);
+        queued.fetch_add(1);
+        queuedEvent.notify();
+      }
+    });
+  }
+
+  std::vector<uint32_t> nextItem(numProducers, 0);
+  uint64_t              total       = uint64_t(numProducers) * numItems;
+  uint64_t              failures    = 0;
+  uint32_t              numDequeued = 0;
+  for(uint64_t n = 0; n < total; n++)
+  {
+    queuedEvent.wait([&]() { return queued.load() != numDequeued; });
+
+    uint64_t value;
+    ring.pop(value);
+    numDequeued++;
+
+    uint32_t p = uint32_t(value >> 32);
+    uint32_t i = uint32_t(value);
+    if(p >= numProducers || i != nextItem[p])
+    {
+      failures++;
+    }
+    else
+    {
+      nextItem[p]++;
+    }
+  }
+
+  for(std::thread& producer : producers)
+  {
+    producer.join();
+  }
+
+  uint64_t leftover;
+  if(ring.tryPop(leftover))
+  {
+    failures++;
+  }
+
+  LOGI("mpsc ring test: %d producers, %d items each: %s\n", numProducers, numItems, failures ? "FAILED" : "passed");
+  return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -24,6 +24,16 @@
 #include "nvh/nvprint.hpp"
 #include <assert.h>
 
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+#endif
+
 #define THREADPOOL_TERMINATE_FUNC ((ThreadPool::WorkerFunc)1)
 
 #define USE_PHYSICAL_CORES_ONLY 1
@@ -176,11 +186,325 @@ unsigned int ThreadPool::sysGetNumCores()
 
 unsigned int ThreadPool::sysGetNumCores()
 {
-  return std::thread::hardware_concurrency();
+  return sysGetTopology().numCores;
 }
 
 #endif
 
+#if defined(__linux__)
+
+static bool ReadSysUint(const char* path, uint32_t& value)
+{
+  FILE* file = fopen(path, "r");
+  if(!file)
+    return false;
+
+  unsigned int read   = 0;
+  bool         result = fscanf(file, "%u", &read) == 1;
+  fclose(file);
+
+  value = read;
+  return result;
+}
+
+// returns the lowest cpu of a list such as "0-3,8-11"
+static bool ReadSysCpuListFirst(const char* path, uint32_t& first)
+{
+  FILE* file = fopen(path, "r");
+  if(!file)
+    return false;
+
+  bool     result = false;
+  uint32_t lowest = ~0u;
+  char     line[4096];
+  if(fgets(line, sizeof(line), file))
+  {
+    const char* str = line;
+    while(*str)
+    {
+      char*         end;
+      unsigned long value = strtoul(str, &end, 10);
+      if(end == str)
+        break;
+
+      lowest = std::min(lowest, uint32_t(value));
+      result = true;
+      str    = end;
+      while(*str == '-' || *str == ',' || *str == '\n')
+        str++;
+    }
+  }
+  fclose(file);
+
+  first = lowest;
+  return result;
+}
+
+static uint32_t ReadSysNumaNode(uint32_t cpu)
+{
+  char path[256];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u", cpu);
+
+  DIR* dir = opendir(path);
+  if(!dir)
+    return 0;
+
+  uint32_t node = 0;
+  while(dirent* entry = readdir(dir))
+  {
+    unsigned int value;
+    if(sscanf(entry->d_name, "node%u", &value) == 1)
+    {
+      node = value;
+      break;
+    }
+  }
+  closedir(dir);
+
+  return node;
+}
+
+static void BuildTopology(ThreadPool::Topology& topology)
+{
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+  {
+    unsigned int numCpus = std::max(std::thread::hardware_concurrency(), 1u);
+    for(unsigned int i = 0; i < numCpus && i < CPU_SETSIZE; i++)
+    {
+      CPU_SET(i, &allowed);
+    }
+  }
+
+  // sysfs ids are sparse and only unique per package, remap to dense indices in cpu order
+  std::unordered_map<uint64_t, uint32_t> coreMap;
+  std::unordered_map<uint64_t, uint32_t> l3Map;
+  std::unordered_map<uint32_t, uint32_t> numaMap;
+
+  for(uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+  {
+    if(!CPU_ISSET(cpu, &allowed))
+      continue;
+
+    char     path[256];
+    uint32_t package = 0;
+    uint32_t coreId  = cpu;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/physical_package_id", cpu);
+    ReadSysUint(path, package);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+    if(!ReadSysUint(path, coreId))
+    {
+      // without sysfs every logical cpu counts as its own core
+      package = 0;
+      coreId  = cpu;
+    }
+
+    // an L3 domain is identified by its lowest cpu, the package if there is no L3
+    uint64_t l3Key = (uint64_t(1) << 32) | package;
+    for(uint32_t index = 0;; index++)
+    {
+      uint32_t level;
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/level", cpu, index);
+      if(!ReadSysUint(path, level))
+        break;
+      if(level != 3)
+        continue;
+
+      uint32_t first;
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cache/index%u/shared_cpu_list", cpu, index);
+      if(ReadSysCpuListFirst(path, first))
+      {
+        l3Key = first;
+      }
+      break;
+    }
+
+    uint64_t coreKey = (uint64_t(package) << 32) | coreId;
+    uint32_t numa    = ReadSysNumaNode(cpu);
+
+    ThreadPool::Topology::Cpu info;
+    info.index = cpu;
+    info.core  = coreMap.emplace(coreKey, uint32_t(coreMap.size())).first->second;
+    info.l3    = l3Map.emplace(l3Key, uint32_t(l3Map.size())).first->second;
+    info.numa  = numaMap.emplace(numa, uint32_t(numaMap.size())).first->second;
+    topology.cpus.push_back(info);
+  }
+
+  topology.numCores = uint32_t(coreMap.size());
+  topology.numL3    = uint32_t(l3Map.size());
+  topology.numNuma  = uint32_t(numaMap.size());
+}
+
+static void PinCurrentThread(const std::vector<uint32_t>& cpus)
+{
+  if(cpus.empty())
+    return;
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for(uint32_t cpu : cpus)
+  {
+    CPU_SET(cpu, &set);
+  }
+  pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+#else
+
+static void BuildTopology(ThreadPool::Topology& topology)
+{
+  unsigned int numCpus = std::max(std::thread::hardware_concurrency(), 1u);
+  for(uint32_t cpu = 0; cpu < numCpus; cpu++)
+  {
+    topology.cpus.push_back({cpu, cpu, 0, 0});
+  }
+
+  topology.numCores = numCpus;
+  topology.numL3    = 1;
+  topology.numNuma  = 1;
+}
+
+#endif
+
+// default matches the former hardcoded pinning on windows
+static std::atomic<ThreadPool::Placement> s_placement(ThreadPool::PLACEMENT_PHYSICAL_CORES);
+
+const ThreadPool::Topology& ThreadPool::sysGetTopology()
+{
+  // built on first use, before any pinning restricts the affinity of the process
+  static const Topology s_topology = []() {
+    Topology topology;
+    BuildTopology(topology);
+    std::stable_sort(topology.cpus.begin(), topology.cpus.end(),
+                     [](const Topology::Cpu& a, const Topology::Cpu& b) { return a.core < b.core; });
+    return topology;
+  }();
+
+  return s_topology;
+}
+
+void ThreadPool::sysSetPlacement(Placement placement)
+{
+  sysGetTopology();
+  s_placement = placement;
+}
+
+ThreadPool::Placement ThreadPool::sysGetPlacement()
+{
+  return s_placement;
+}
+
+#if defined(__linux__)
+// order in which placement slots use the cpus: one cpu of every core except the first,
+// then their SMT siblings, the cpus of the first core that the main thread usually runs on come last
+static const std::vector<uint32_t>& GetWorkerCpuOrder()
+{
+  static const std::vector<uint32_t> s_order = []() {
+    const ThreadPool::Topology& topology = ThreadPool::sysGetTopology();
+
+    std::vector<uint32_t> primary;
+    std::vector<uint32_t> siblings;
+    std::vector<uint32_t> first;
+    uint32_t              lastCore = ~0u;
+    for(const ThreadPool::Topology::Cpu& cpu : topology.cpus)
+    {
+      if(cpu.core == 0)
+        first.push_back(cpu.index);
+      else if(cpu.core != lastCore)
+        primary.push_back(cpu.index);
+      else
+        siblings.push_back(cpu.index);
+      lastCore = cpu.core;
+    }
+
+    primary.insert(primary.end(), siblings.begin(), siblings.end());
+    primary.insert(primary.end(), first.begin(), first.end());
+    return primary;
+  }();
+
+  return s_order;
+}
+#endif
+
+// slots of all pinned workers, so ThreadPool and TaskScheduler workers don't share cpus while there are enough
+static std::mutex        s_placementSlotsMutex;
+static std::vector<bool> s_placementSlots;
+
+unsigned int ThreadPool::sysAcquirePlacementSlot()
+{
+  std::lock_guard<std::mutex> lock(s_placementSlotsMutex);
+
+  size_t slot = std::find(s_placementSlots.begin(), s_placementSlots.end(), false) - s_placementSlots.begin();
+  if(slot == s_placementSlots.size())
+  {
+    s_placementSlots.push_back(true);
+  }
+  else
+  {
+    s_placementSlots[slot] = true;
+  }
+  return unsigned(slot);
+}
+
+void ThreadPool::sysReleasePlacementSlot(unsigned int slot)
+{
+  std::lock_guard<std::mutex> lock(s_placementSlotsMutex);
+  assert(slot < s_placementSlots.size() && s_placementSlots[slot]);
+  s_placementSlots[slot] = false;
+}
+
+void ThreadPool::sysPinWorkerThread(unsigned int slot)
+{
+  Placement placement = s_placement;
+  if(placement == PLACEMENT_NONE)
+    return;
+
+#if _WIN32 && USE_PHYSICAL_CORES_ONLY
+  if(placement == PLACEMENT_PHYSICAL_CORES)
+  {
+    // assume hyperthreading, move to n physical cores
+    unsigned int cpuCore = (slot * 2 + 1) % std::min(std::max(std::thread::hardware_concurrency(), 1u), 64u);
+    SetThreadAffinityMask(GetCurrentThread(), uint64_t(1) << cpuCore);
+  }
+#elif defined(__linux__)
+  const Topology&       topology = sysGetTopology();
+  std::vector<uint32_t> cpus;
+  if(placement == PLACEMENT_PHYSICAL_CORES)
+  {
+    const std::vector<uint32_t>& order = GetWorkerCpuOrder();
+    if(!order.empty())
+    {
+      cpus.push_back(order[slot % order.size()]);
+    }
+  }
+  else if(placement == PLACEMENT_L3_DOMAINS)
+  {
+    uint32_t l3 = slot % topology.numL3;
+    for(const Topology::Cpu& cpu : topology.cpus)
+    {
+      if(cpu.l3 == l3)
+      {
+        cpus.push_back(cpu.index);
+      }
+    }
+  }
+  PinCurrentThread(cpus);
+#endif
+}
+
+void ThreadPool::sysPinMainThread()
+{
+  if(s_placement != PLACEMENT_PHYSICAL_CORES)
+    return;
+
+#if _WIN32 && USE_PHYSICAL_CORES_ONLY
+  // pin the main thread to core 0
+  SetThreadAffinityMask(GetCurrentThread(), 1);
+#endif
+  // not on Linux, threads created later (driver, short-lived helpers) would inherit the single cpu
+}
+
 
 void ThreadPool::threadKicker(void* arg)
 {
@@ -199,11 +523,7 @@ void ThreadPool::threadProcess(ThreadEntry& entry)
     m_globalCond.notify_all();
   }
 
-#if _WIN32 && USE_PHYSICAL_CORES_ONLY
-  // assume hyperthreading, move to n physical cores
-  unsigned int cpuCore = entry.m_id * 2 + 1;
-  SetThreadAffinityMask(GetCurrentThread(), uint64_t(1) << cpuCore);
-#endif
+  sysPinWorkerThread(entry.m_placementSlot);
 
   while(true)
   {
@@ -245,11 +565,12 @@ void ThreadPool::init(unsigned int numThreads)
 
   for(unsigned int i = 0; i < numThreads; i++)
   {
-    ThreadEntry& entry = m_pool[i];
-    entry.m_id         = numThreads - i - 1;
-    entry.m_origin     = this;
-    entry.m_fn         = 0;
-    entry.m_fnArg      = 0;
+    ThreadEntry& entry    = m_pool[i];
+    entry.m_id            = numThreads - i - 1;
+    entry.m_origin        = this;
+    entry.m_fn            = 0;
+    entry.m_fnArg         = 0;
+    entry.m_placementSlot = sysAcquirePlacementSlot();
   }
 
   NV_BARRIER();
@@ -268,10 +589,7 @@ void ThreadPool::init(unsigned int numThreads)
     }
   }
 
-#if _WIN32 && USE_PHYSICAL_CORES_ONLY
-  // pin the main thread to core 0
-  SetThreadAffinityMask(GetCurrentThread(), 1);
-#endif
+  sysPinMainThread();
 }
 
 void ThreadPool::deinit()
@@ -292,6 +610,7 @@ void ThreadPool::deinit()
     std::this_thread::yield();
 
     entry.m_thread.join();
+    sysReleasePlacementSlot(entry.m_placementSlot);
   }
 
   delete[] m_pool;
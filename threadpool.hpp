@@ -21,11 +21,199 @@
 #ifndef THREADPOOL_H__
 #define THREADPOOL_H__
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
+#include "taskscheduler.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define THREAD_PAUSE() _mm_pause()
+#else
+#define THREAD_PAUSE() std::this_thread::yield()
+#endif
+
+// Waits for a condition other threads publish. Waiters spin for a while and
+// only park on the condition variable when that fails, notify only takes the
+// mutex when someone is parked. The spin budget grows while spinning succeeds
+// and shrinks when waiters end up parking anyway.
+// The predicate must read, and the notifier write, its state with seq_cst atomics.
+class SpinParkEvent
+{
+public:
+  static constexpr uint32_t MIN_SPINS = 64;
+  static constexpr uint32_t MAX_SPINS = 1 << 14;
+
+  // false parks right away, spinning is pointless without a second cpu
+  void setSpinning(bool spinning) { m_spinning = spinning && std::thread::hardware_concurrency() > 1; }
+
+  // call after the state was changed
+  void notify()
+  {
+    if(m_numParked.load())
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cond.notify_all();
+    }
+  }
+
+  template <class P>
+  void wait(P&& predicate)
+  {
+    uint32_t spins = m_spinning ? m_spins.load(std::memory_order_relaxed) : 0;
+    for(uint32_t i = 0; i < spins; i++)
+    {
+      if(predicate())
+      {
+        m_spins.store(std::min(spins + spins / 8 + 1, MAX_SPINS), std::memory_order_relaxed);
+        return;
+      }
+      THREAD_PAUSE();
+    }
+
+    // pairs with the m_numParked check in notify, either the predicate sees the
+    // new state or the notifier sees this waiter
+    m_numParked.fetch_add(1);
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while(!predicate())
+      {
+        m_cond.wait(lock);
+      }
+    }
+    m_numParked.fetch_sub(1);
+
+    if(m_spinning)
+    {
+      m_spins.store(std::max(spins / 2, MIN_SPINS), std::memory_order_relaxed);
+    }
+  }
+
+private:
+  bool                    m_spinning = true;
+  std::atomic<uint32_t>   m_spins{MIN_SPINS};
+  std::atomic<uint32_t>   m_numParked{0};
+  std::mutex              m_mutex;
+  std::condition_variable m_cond;
+};
+
+// Bounded multi-producer single-consumer ring. Every slot carries a sequence
+// number, producers claim slots with a CAS on the tail and the consumer reads
+// without any atomic read-modify-write. Nothing is allocated after init.
+template <class T>
+class MpscRing
+{
+public:
+  // not thread-safe, the capacity is rounded up to a power of two
+  void init(size_t capacity)
+  {
+    size_t size = 1;
+    while(size < capacity)
+    {
+      size *= 2;
+    }
+
+    m_slots.reset(new Slot[size]);
+    m_mask = size - 1;
+    m_head = 0;
+    m_tail.store(0, std::memory_order_relaxed);
+    for(size_t i = 0; i < size; i++)
+    {
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  size_t getCapacity() const { return m_slots ? m_mask + 1 : 0; }
+
+  // returns false if the ring is full
+  bool tryPush(const T& value)
+  {
+    size_t pos = m_tail.load(std::memory_order_relaxed);
+    while(true)
+    {
+      Slot&     slot     = m_slots[pos & m_mask];
+      size_t    sequence = slot.sequence.load(std::memory_order_acquire);
+      ptrdiff_t diff     = ptrdiff_t(sequence) - ptrdiff_t(pos);
+      if(diff == 0)
+      {
+        if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          slot.value = value;
+          slot.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if(diff < 0)
+      {
+        // the consumer has not released this slot from the previous lap yet
+        return false;
+      }
+      else
+      {
+        pos = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void push(const T& value)
+  {
+    while(!tryPush(value))
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  // single consumer only, returns false if the ring is empty
+  bool tryPop(T& value)
+  {
+    Slot& slot = m_slots[m_head & m_mask];
+    if(slot.sequence.load(std::memory_order_acquire) != m_head + 1)
+      return false;
+
+    value = slot.value;
+    slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+    m_head++;
+    return true;
+  }
+
+  // single consumer only. Pushes complete out of order, so even when a push is known
+  // to have finished, the oldest slot may still be in the middle of being written.
+  void pop(T& value)
+  {
+    for(uint32_t spins = 0; !tryPop(value); spins++)
+    {
+      if(spins < 1024)
+      {
+        THREAD_PAUSE();
+      }
+      else
+      {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  // own cache line per slot, producers finishing neighbouring slots don't interfere
+  struct alignas(64) Slot
+  {
+    std::atomic<size_t> sequence;
+    T                   value;
+  };
+
+  std::unique_ptr<Slot[]> m_slots;
+  size_t                  m_mask = 0;
+  size_t                  m_head = 0;
+
+  alignas(64) std::atomic<size_t> m_tail{0};
+};
+
 class ThreadPool
 {
 
@@ -37,10 +225,100 @@ public:
 
   void activateJob(unsigned int thread, WorkerFunc fn, void* arg);
 
+  enum Placement
+  {
+    PLACEMENT_NONE,            // threads are not pinned
+    PLACEMENT_PHYSICAL_CORES,  // one worker per cpu, other cores first, then SMT siblings, the first core last
+    PLACEMENT_L3_DOMAINS,      // workers round-robin over L3 domains, free to move within their domain
+  };
+
+  struct Topology
+  {
+    struct Cpu
+    {
+      uint32_t index;  // logical cpu as used by the OS
+      uint32_t core;   // physical core, SMT siblings share it
+      uint32_t l3;
+      uint32_t numa;
+    };
+
+    // logical cpus the process may run on, ordered by core
+    std::vector<Cpu> cpus;
+    uint32_t         numCores = 0;
+    uint32_t         numL3    = 0;
+    uint32_t         numNuma  = 0;
+  };
+
+  // physical cores the process may run on
   static unsigned int sysGetNumCores();
+  // from sysfs on Linux, elsewhere every logical cpu counts as its own core
+  static const Topology& sysGetTopology();
+
+  // used by ThreadPool and TaskScheduler workers started afterwards
+  static void      sysSetPlacement(Placement placement);
+  static Placement sysGetPlacement();
+
+  // Every pinned worker holds a slot, the lowest free one is handed out. Slots map to
+  // distinct cpus as long as there are enough, so the worker pools don't overlap.
+  static unsigned int sysAcquirePlacementSlot();
+  static void         sysReleasePlacementSlot(unsigned int slot);
+  static void         sysPinWorkerThread(unsigned int slot);
+  // windows only, on Linux threads created afterwards would inherit the pinning
+  static void sysPinMainThread();
 
   unsigned int getNumThreads() { return m_numThreads; }
 
+  // runs fn(begin, end) over [0, numItems) in batches of batchSize on up to numThreads
+  // threads (the calling thread participates). Batches are handed out dynamically, so
+  // fn must only depend on the item indices for deterministic results.
+  // Uses the workers of TaskScheduler::getGlobal() if initialized, otherwise short-lived threads.
+  template <class F>
+  static void parallelBatches(size_t numItems, size_t batchSize, unsigned int numThreads, F&& fn)
+  {
+    TaskScheduler& scheduler = TaskScheduler::getGlobal();
+    if(scheduler.isInitialized())
+    {
+      scheduler.parallelFor(numItems, batchSize, numThreads, fn);
+      return;
+    }
+
+    batchSize  = std::max(batchSize, size_t(1));
+    numThreads = unsigned(std::min(size_t(numThreads), (numItems + batchSize - 1) / batchSize));
+
+    if(numThreads <= 1)
+    {
+      if(numItems)
+      {
+        fn(size_t(0), numItems);
+      }
+      return;
+    }
+
+    std::atomic<size_t> counter(0);
+
+    auto worker = [&]() {
+      while(true)
+      {
+        size_t begin = counter.fetch_add(batchSize);
+        if(begin >= numItems)
+          break;
+
+        fn(begin, std::min(begin + batchSize, numItems));
+      }
+    };
+
+    std::vector<std::thread> threads(numThreads - 1);
+    for(size_t t = 0; t < threads.size(); t++)
+    {
+      threads[t] = std::thread(worker);
+    }
+    worker();
+    for(size_t t = 0; t < threads.size(); t++)
+    {
+      threads[t].join();
+    }
+  }
+
 
 private:
   struct ThreadEntry
@@ -48,6 +326,7 @@ private:
     ThreadPool*             m_origin;
     std::thread             m_thread;
     unsigned int            m_id;
+    unsigned int            m_placementSlot;
     WorkerFunc              m_fn;
     void*                   m_fnArg;
     std::mutex              m_commMutex;
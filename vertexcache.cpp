@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#include "vertexcache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+// scoring constants from the paper
+#define VERTEXCACHE_MAX_VALENCE 32
+
+static const float s_cacheDecayPower   = 1.5f;
+static const float s_lastTriangleScore = 0.75f;
+static const float s_valenceBoostScale = 2.0f;
+static const float s_valenceBoostPower = 0.5f;
+
+struct VertexScoreTable
+{
+  float cache[VERTEXCACHE_SIZE];
+  float valence[VERTEXCACHE_MAX_VALENCE];
+
+  VertexScoreTable()
+  {
+    for(int i = 0; i < VERTEXCACHE_SIZE; i++)
+    {
+      // the vertices of the last triangle get a fixed score, so that the
+      // next triangle does not simply continue a strip
+      cache[i] = i < 3 ? s_lastTriangleScore :
+                         powf(1.0f - float(i - 3) / float(VERTEXCACHE_SIZE - 3), s_cacheDecayPower);
+    }
+    valence[0] = 0;
+    for(int i = 1; i < VERTEXCACHE_MAX_VALENCE; i++)
+    {
+      // boost vertices with few triangles left, to get rid of lone triangles early
+      valence[i] = s_valenceBoostScale * powf(float(i), -s_valenceBoostPower);
+    }
+  }
+};
+
+static const VertexScoreTable s_scoreTable;
+
+static inline float vertexScore(int32_t cachePos, uint32_t remaining)
+{
+  if(remaining == 0)
+  {
+    // no triangle needs it anymore
+    return -1.0f;
+  }
+
+  float score = cachePos >= 0 ? s_scoreTable.cache[cachePos] : 0.0f;
+  score += remaining < VERTEXCACHE_MAX_VALENCE ? s_scoreTable.valence[remaining] :
+                                                 s_valenceBoostScale * powf(float(remaining), -s_valenceBoostPower);
+  return score;
+}
+
+void VertexCacheOptimizer::init(uint32_t numVertices)
+{
+  m_remaining.assign(numVertices, 0);
+  m_adjacencyStart.assign(numVertices, 0);
+  m_score.assign(numVertices, 0);
+  m_touched.clear();
+}
+
+void VertexCacheOptimizer::optimizeTriangles(uint32_t* indices, size_t numIndices)
+{
+  size_t numTriangles = numIndices / 3;
+  if(numTriangles < 2)
+    return;
+
+  // per-vertex triangle lists, only for the vertices this call touches
+  m_touched.clear();
+  for(size_t i = 0; i < numTriangles * 3; i++)
+  {
+    uint32_t v = indices[i];
+    assert(v < m_remaining.size());
+    if(m_remaining[v]++ == 0)
+    {
+      m_touched.push_back(v);
+    }
+  }
+
+  uint32_t offset = 0;
+  for(uint32_t v : m_touched)
+  {
+    m_adjacencyStart[v] = offset;
+    offset += m_remaining[v];
+    // reused as fill counter below
+    m_remaining[v] = 0;
+  }
+
+  m_adjacency.resize(numTriangles * 3);
+  for(size_t t = 0; t < numTriangles; t++)
+  {
+    for(int k = 0; k < 3; k++)
+    {
+      uint32_t v                                          = indices[t * 3 + k];
+      m_adjacency[m_adjacencyStart[v] + m_remaining[v]++] = uint32_t(t);
+    }
+  }
+
+  for(uint32_t v : m_touched)
+  {
+    m_score[v] = vertexScore(-1, m_remaining[v]);
+  }
+
+  m_triangleScore.resize(numTriangles);
+  m_triangleAdded.assign(numTriangles, 0);
+  for(size_t t = 0; t < numTriangles; t++)
+  {
+    m_triangleScore[t] = m_score[indices[t * 3 + 0]] + m_score[indices[t * 3 + 1]] + m_score[indices[t * 3 + 2]];
+  }
+
+  // three more entries than the cache, to hold the vertices that just fell out
+  uint32_t cache[VERTEXCACHE_SIZE + 3];
+  uint32_t cacheCount = 0;
+
+  m_output.resize(numTriangles * 3);
+
+  size_t  nextUnadded  = 0;
+  int64_t bestTriangle = -1;
+
+  for(size_t out = 0; out < numTriangles; out++)
+  {
+    if(bestTriangle < 0)
+    {
+      // nothing in the cache connects to a remaining triangle, continue in input order
+      while(m_triangleAdded[nextUnadded])
+      {
+        nextUnadded++;
+      }
+      bestTriangle = int64_t(nextUnadded);
+    }
+
+    size_t          t   = size_t(bestTriangle);
+    const uint32_t* tri = &indices[t * 3];
+
+    m_triangleAdded[t] = 1;
+    for(int k = 0; k < 3; k++)
+    {
+      m_output[out * 3 + k] = tri[k];
+    }
+
+    // remove the triangle from the lists of its vertices
+    for(int k = 0; k < 3; k++)
+    {
+      uint32_t  v     = tri[k];
+      uint32_t* list  = &m_adjacency[m_adjacencyStart[v]];
+      uint32_t  count = m_remaining[v];
+      for(uint32_t i = 0; i < count; i++)
+      {
+        if(list[i] == t)
+        {
+          list[i] = list[count - 1];
+          break;
+        }
+      }
+      m_remaining[v] = count - 1;
+    }
+
+    // the triangle's vertices move to the front of the LRU cache
+    uint32_t newCache[VERTEXCACHE_SIZE + 3];
+    uint32_t newCount = 0;
+    for(int k = 0; k < 3; k++)
+    {
+      if(std::find(newCache, newCache + newCount, tri[k]) == newCache + newCount)
+      {
+        newCache[newCount++] = tri[k];
+      }
+    }
+    for(uint32_t i = 0; i < cacheCount; i++)
+    {
+      uint32_t v = cache[i];
+      if(v != tri[0] && v != tri[1] && v != tri[2])
+      {
+        newCache[newCount++] = v;
+      }
+    }
+
+    // update scores of everything that was or is in the cache, the
+    // triangle scores change by the delta of their vertex scores
+    for(uint32_t i = 0; i < newCount; i++)
+    {
+      uint32_t v        = newCache[i];
+      int32_t  cachePos = i < VERTEXCACHE_SIZE ? int32_t(i) : -1;
+      float    score    = vertexScore(cachePos, m_remaining[v]);
+      float    delta    = score - m_score[v];
+
+      m_score[v] = score;
+
+      const uint32_t* list = &m_adjacency[m_adjacencyStart[v]];
+      for(uint32_t a = 0; a < m_remaining[v]; a++)
+      {
+        m_triangleScore[list[a]] += delta;
+      }
+    }
+
+    cacheCount = std::min(newCount, uint32_t(VERTEXCACHE_SIZE));
+    std::copy(newCache, newCache + cacheCount, cache);
+
+    // best candidate among the triangles using cached vertices
+    float bestScore = -1.0f;
+    bestTriangle    = -1;
+    for(uint32_t i = 0; i < cacheCount; i++)
+    {
+      uint32_t        v    = cache[i];
+      const uint32_t* list = &m_adjacency[m_adjacencyStart[v]];
+      for(uint32_t a = 0; a < m_remaining[v]; a++)
+      {
+        if(m_triangleScore[list[a]] > bestScore)
+        {
+          bestScore    = m_triangleScore[list[a]];
+          bestTriangle = list[a];
+        }
+      }
+    }
+  }
+
+  std::copy(m_output.begin(), m_output.end(), indices);
+
+  // leave the per-vertex state clean for the next call
+  for(uint32_t v : m_touched)
+  {
+    m_remaining[v] = 0;
+    m_score[v]     = 0;
+  }
+}
+
+size_t vertexCacheCountMisses(const uint32_t* indices, size_t numIndices, uint32_t numVertices, uint32_t cacheSize)
+{
+  // a vertex is cached while fewer than cacheSize misses happened since it was inserted
+  std::vector<size_t> insertedAt(numVertices, 0);
+  std::vector<bool>   seen(numVertices, false);
+
+  size_t misses = 0;
+  for(size_t i = 0; i < numIndices; i++)
+  {
+    uint32_t v = indices[i];
+    if(!seen[v] || misses - insertedAt[v] >= cacheSize)
+    {
+      seen[v]       = true;
+      insertedAt[v] = misses;
+      misses++;
+    }
+  }
+
+  return misses;
+}
+
+void vertexFetchOptimize(uint32_t* indices, size_t numIndices, uint32_t numVertices, uint32_t* newToOld)
+{
+  const uint32_t        unused = ~0u;
+  std::vector<uint32_t> oldToNew(numVertices, unused);
+
+  uint32_t next = 0;
+  for(size_t i = 0; i < numIndices; i++)
+  {
+    uint32_t v = indices[i];
+    if(oldToNew[v] == unused)
+    {
+      oldToNew[v]    = next;
+      newToOld[next] = v;
+      next++;
+    }
+    indices[i] = oldToNew[v];
+  }
+
+  for(uint32_t v = 0; v < numVertices; v++)
+  {
+    if(oldToNew[v] == unused)
+    {
+      newToOld[next++] = v;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2024, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-FileCopyrightText: Copyright (c) 2024 NVIDIA CORPORATION
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+
+#ifndef VERTEXCACHE_H__
+#define VERTEXCACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Import-time reordering of triangle lists for post-transform vertex cache
+// locality, and of vertices for fetch locality.
+
+// cache size the triangle order is optimized for and ACMR is measured with
+#define VERTEXCACHE_SIZE 32
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+// The scratch memory is sized for the geometry once and reset per call,
+// so optimizing many small parts of one geometry stays linear.
+class VertexCacheOptimizer
+{
+public:
+  void init(uint32_t numVertices);
+
+  // reorders the triangles in place, all indices must be < numVertices
+  void optimizeTriangles(uint32_t* indices, size_t numIndices);
+
+private:
+  std::vector<uint32_t> m_remaining;
+  std::vector<uint32_t> m_adjacencyStart;
+  std::vector<float>    m_score;
+  std::vector<uint32_t> m_touched;
+
+  std::vector<uint32_t> m_adjacency;
+  std::vector<float>    m_triangleScore;
+  std::vector<uint8_t>  m_triangleAdded;
+  std::vector<uint32_t> m_output;
+};
+
+// number of vertex shader invocations with a FIFO cache of cacheSize entries,
+// divide by the number of triangles to get the average cache miss ratio (ACMR)
+size_t vertexCacheCountMisses(const uint32_t* indices, size_t numIndices, uint32_t numVertices, uint32_t cacheSize = VERTEXCACHE_SIZE);
+
+// renumbers vertices in order of first use and rewrites the indices accordingly.
+// newToOld receives numVertices entries, unreferenced vertices keep their relative order at the end.
+void vertexFetchOptimize(uint32_t* indices, size_t numIndices, uint32_t numVertices, uint32_t* newToOld);
+
+#endif